@@ -0,0 +1,41 @@
+/*
+ * allocator.c - the table of allocators linked into a driver.
+ *
+ * ALLOCATORS lists them as X(name) ... and defaults to the single allocator
+ * named mm. The Makefile sets it for mdriver-all.
+ */
+#include <stdlib.h>
+
+#include "allocator.h"
+
+#ifndef ALLOCATORS
+#define ALLOCATORS X(mm)
+#endif
+
+#define X(name)                                                                \
+  extern int name##_init(void);                                                \
+  extern void *name##_malloc(size_t size);                                     \
+  extern void name##_free(void *ptr);                                          \
+  extern void *name##_realloc(void *ptr, size_t size);                         \
+  extern void *name##_calloc(size_t nmemb, size_t size);                       \
+  extern void name##_checkheap(int verbose);
+ALLOCATORS
+#undef X
+
+static int libc_init(void) {
+  return 0;
+}
+
+static void libc_checkheap(int verbose __attribute__((unused))) {
+}
+
+const allocator_t allocators[] = {
+#define X(name)                                                                \
+  {#name, name##_init, name##_malloc, name##_free, name##_realloc,             \
+   name##_calloc, name##_checkheap, 1},
+  ALLOCATORS
+#undef X
+  {"libc", libc_init, malloc, free, realloc, calloc, libc_checkheap, 0},
+};
+
+const int num_allocators = sizeof(allocators) / sizeof(allocators[0]);
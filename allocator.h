@@ -0,0 +1,22 @@
+#include <stddef.h>
+
+/*
+ * The allocators linked into a driver. Each one provides the functions of
+ * mm.h; the allocator called <name> provides them as <name>_malloc etc.
+ * The plain drivers link one allocator named mm. mdriver-all links mm.c and
+ * every mm-<name>.c, with their mm_* functions renamed to <name>_*, so all
+ * of them can be compared in one run. libc malloc is always the last one.
+ */
+typedef struct {
+  const char *name;
+  int (*init)(void);
+  void *(*malloc)(size_t size);
+  void (*free)(void *ptr);
+  void *(*realloc)(void *ptr, size_t size);
+  void *(*calloc)(size_t nmemb, size_t size);
+  void (*checkheap)(int verbose);
+  int sim_heap; /* does it allocate from memlib's simulated heap? */
+} allocator_t;
+
+extern const allocator_t allocators[];
+extern const int num_allocators;
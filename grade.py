@@ -1,6 +1,5 @@
 #!/usr/bin/env python3
 
-import math
 import signal
 import subprocess
 import sys
@@ -75,7 +74,17 @@ TRACEFILES_EXTRA = [
         "traces-private/seglist.rep"]
 
 
-def runtrace(trace):
+def driver_files(allocator):
+    """Return the driver binary and object file of the given allocator.
+
+    'mm' is the boundary tag allocator from mm.c, any other name selects
+    mm-<name>.c linked into mdriver-<name> (see Makefile)."""
+    if allocator == 'mm':
+        return './mdriver', 'mm.o'
+    return f'./mdriver-{allocator}', f'mm-{allocator}.o'
+
+
+def runtrace(trace, driver='./mdriver'):
     mdriver = subprocess.run([
         "valgrind",
         "--tool=callgrind",
@@ -84,7 +93,7 @@ def runtrace(trace):
         "--toggle-collect=mm_free",
         "--toggle-collect=mm_realloc",
         "--toggle-collect=mm_calloc",
-        "--", "./mdriver", "-f", trace],
+        "--", driver, "-f", trace],
         capture_output=True, timeout=TIMEOUT)
 
     output = mdriver.stdout.decode()
@@ -132,18 +141,18 @@ def runtrace(trace):
     return util, insn, used, total
 
 
-def check_symbols():
-    nm = subprocess.run(['nm', '-g', '--defined-only', 'mm.o'],
+def check_symbols(obj='mm.o'):
+    nm = subprocess.run(['nm', '-g', '--defined-only', obj],
                         stdout=subprocess.PIPE)
     for line in nm.stdout.decode().splitlines():
         symbol = line.split()[-1]
         if symbol not in STUDENT_DEFINED:
-            print(f'Symbol "{symbol}" in "mm.o" cannot be visible externally!')
+            print(f'Symbol "{symbol}" in "{obj}" cannot be visible externally!')
             raise SystemExit("Your solution was disqualified! :(")
 
 
-def check_sections():
-    objdump = subprocess.run(['objdump', '-h', 'mm.o'],
+def check_sections(obj='mm.o'):
+    objdump = subprocess.run(['objdump', '-h', obj],
                              stdout=subprocess.PIPE)
 
     data_size = 0
@@ -160,9 +169,11 @@ def check_sections():
         raise SystemExit("Your solution was disqualified! :(")
 
 
-if __name__ == '__main__':
-    check_symbols()
-    check_sections()
+def grade(allocator):
+    driver, obj = driver_files(allocator)
+
+    check_symbols(obj)
+    check_sections(obj)
 
     all_ops = []
     all_insn = []
@@ -171,7 +182,7 @@ if __name__ == '__main__':
     all_total = []
 
     for trace in TRACEFILES:
-        print("\nRunning mdriver for '%s'..." % trace)
+        print("\nRunning %s for '%s'..." % (driver[2:], trace))
 
         with open(trace, "r") as f:
             _ = int(f.readline())
@@ -180,10 +191,11 @@ if __name__ == '__main__':
 
         util = 0.0              # default utilization penalty for timeout
         insn = 50000.0 * ops    # default throughput penalty for timeout
-        heapsz = math.inf
+        used = 0
+        total = 0
 
         try:
-            util, insn, used, total = runtrace(trace)
+            util, insn, used, total = runtrace(trace, driver)
         except subprocess.TimeoutExpired:
             print("Penalty accrued for timeout of %ds." % TIMEOUT)
 
@@ -204,6 +216,49 @@ if __name__ == '__main__':
     print("Total memory utilization: %.2f%%" % (100.0 * total_util))
     print("Instructions per operation: %d" % (sum(all_insn) / sum(all_ops)))
 
+    return {'weighted_util': weighted_util,
+            'total_util': 100.0 * total_util,
+            'insn_per_op': sum(all_insn) / sum(all_ops),
+            'util': all_util,
+            'insn': [insn / ops for insn, ops in zip(all_insn, all_ops)]}
+
+
+def compare(allocators, results):
+    """Print per-trace utilization and instructions per operation side by
+    side, each allocator after the first one with a delta to the first."""
+    print("\nComparison of %s:" % ", ".join(allocators))
+    header = "%-28s" % "trace"
+    for allocator in allocators:
+        header += " %16s" % allocator
+    print(header)
+
+    first = results[0]
+    for i, trace in enumerate(TRACEFILES):
+        row = "%-28s" % trace.split('/')[-1]
+        for res in results:
+            row += " %6.1f%% %8d" % (res['util'][i], res['insn'][i])
+        print(row)
+
+    for key, fmt in [('weighted_util', "%.1f%%"), ('total_util', "%.2f%%"),
+                     ('insn_per_op', "%d")]:
+        row = "%-28s" % key
+        for res in results:
+            delta = res[key] - first[key]
+            cell = fmt % res[key]
+            if res is not first:
+                cell += " (%+.1f)" % delta
+            row += " %16s" % cell
+        print(row)
+
+
+if __name__ == '__main__':
+    allocators = sys.argv[1:] or ['mm']
+    results = [grade(allocator) for allocator in allocators]
+
+    if len(allocators) > 1:
+        compare(allocators, results)
+
+    weighted_util = results[0]['weighted_util']
     if weighted_util < MINUTIL:
         print("Minimum threshold for memory utilization "
               "of %d%% has not been met!" % MINUTIL)
@@ -9,21 +9,41 @@
  *
  * WARNING! This file has been heavily modified compared to the original.
  */
+#define _GNU_SOURCE
 #include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <float.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
-#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
+#include "allocator.h"
 #include "memlib.h"
 #include "mm.h"
+#include "perfctr.h"
+#include "region.h"
+#include "tracebin.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 /**********************
  * Constants and macros
@@ -43,6 +63,29 @@
 #define WUTIL 2
 #define WPERF 3
 
+/* chunk size of regions created in region mode */
+#define REGION_CHUNK 4096
+
+/* timed runs kept per trace for baseline comparisons */
+#define MAX_SAMPLES 100
+
+/* requests between samples of the resident heap size */
+#define RSS_EVERY 64
+
+/* runs for -B and -C unless set by -k and -w */
+#define BASELINE_RUNS 21
+#define BASELINE_WARMUP 2
+
+/* a trace moved if its times differ at this level and by this fraction,
+   if it lost this much utilization or needs this many more instructions */
+#define SIGNIFICANCE 0.01
+#define MIN_EFFECT 0.02
+#define MIN_UTIL 0.0005
+#define MIN_INSTR 0.01
+
+/* requests decoded at once from binary traces */
+#define OPS_CHUNK (1 << 16)
+
 /******************************
  * The key compound data types
  *****************************/
@@ -54,25 +97,36 @@
  * Remember that index (-1) is the null pointer.
  */
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload. Ranges are kept in a skip list
+ * ordered by lo; the list head is a range_t with RANGE_LEVELS links.
+ */
+#define RANGE_LEVELS 24
+
 typedef struct range_t {
-  char *lo;             /* low payload address */
-  char *hi;             /* high payload address */
-  struct range_t *next; /* next list element */
-  int index;            /* same index as free; for debugging */
+  char *lo;               /* low payload address */
+  char *hi;               /* high payload address */
+  int index;              /* same index as free; for debugging */
+  int height;             /* number of forward links */
+  struct range_t *next[]; /* next[0] links all ranges in address order */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/*
+ * Characterizes a single trace operation (allocator request)
+ * - RALLOC is ALLOC of a block tagged with a region (trace->block_region),
+ * - RESET ends region "index": all its live blocks die at once; they are
+ *   listed in trace->reset_ids starting at "size" and terminated by -1.
+ */
 typedef struct {
-  enum { ALLOC, FREE, REALLOC } type; /* type of request */
-  int index;                          /* index for free() to use later */
-  size_t size;                        /* byte size of alloc/realloc request */
+  enum { ALLOC, FREE, REALLOC, RALLOC, RESET } type; /* type of request */
+  int index;   /* index for free() to use later */
+  size_t size; /* byte size of alloc/realloc request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
   char filename[MAXLINE];
-  int ignore_ranges;    /* don't check ranges (i.e. this is too big) */
+  int ignore_ranges;    /* unused, ranges are always checked */
   int num_ids;          /* number of alloc/realloc ids */
   int num_ops;          /* number of distinct requests */
   int weight;           /* weight for this trace (unused) */
@@ -80,11 +134,30 @@ typedef struct {
   char **blocks;        /* array of ptrs returned by malloc/realloc... */
   size_t *block_sizes;  /* ... and a corresponding array of payload sizes */
   int *block_rand_base; /* index into random_data, if debug is on */
+  int num_regions;      /* number of region ids */
+  int *block_region;    /* region of each block or -1 */
+  int *reset_ids;       /* lists of blocks that die at RESET */
+  mm_region_t **regions; /* regions used in region mode */
+  int chunk_base;       /* ops holds requests chunk_base... */
+  int chunk_len;        /* ... up to chunk_base + chunk_len - 1 */
+
+  /* binary traces are decoded from a mapping of the file, see load_chunk */
+  const uint8_t *map; /* the mapped file */
+  size_t maplen;      /* ... and its length */
+  size_t dropped;     /* bytes of the mapping released so far */
+  uint32_t flags;     /* TRACEBIN_* flags of the header */
+  const uint8_t *pos; /* next request to decode ... */
+  int pos_op;         /* ... and its number */
+  int reset_cap;      /* capacity of reset_ids */
+  int *region_head;   /* last block allocated in each region ... */
+  int *region_next;   /* ... and the block allocated before it */
+  char *live;         /* which blocks are allocated */
+  int *op_threads;    /* thread of each request in ops, if recorded */
 } trace_t;
 
 /*
- * Holds the params to the xxx_speed functions, which are timed by fcyc.
- * This struct is necessary because fcyc accepts only a pointer array
+ * Holds the params to the xxx_speed functions, which are timed by fsecs.
+ * This struct is necessary because fsecs accepts only a pointer
  * as input.
  */
 typedef struct {
@@ -92,21 +165,104 @@ typedef struct {
   range_t *ranges;
 } speed_t;
 
+/*
+ * Log-linear latency histogram, as in HdrHistogram. Values below LAT_SUB
+ * get a bucket each; above that every power of two is split into LAT_SUB
+ * buckets, so a bucket is never wider than 1/LAT_SUB of its values.
+ */
+#define LAT_SUB_BITS 5
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+typedef struct {
+  uint64_t count[LAT_BUCKETS]; /* number of ops per bucket */
+  uint64_t ops;                /* total number of ops */
+  uint64_t max;                /* slowest op... */
+  int worst;                   /* ... and its opnum */
+} latency_t;
+
+/*
+ * A request replayed by a thread, see eval_threads. seq counts the earlier
+ * requests on the same block, all of which must be done before this one.
+ */
+typedef struct {
+  traceop_t op;
+  int opnum; /* request number in the trace */
+  int seq;
+} mtop_t;
+
+/* One replay thread and the requests it runs, in trace order */
+typedef struct {
+  pthread_t tid;
+  trace_t *trace;
+  mtop_t *ops;
+  int num_ops, max_ops;
+  int *done;     /* requests done on each block, shared by all threads */
+  latency_t lat; /* latency of all its requests */
+} worker_t;
+
+/* Parameters of eval_threads_speed */
+typedef struct {
+  trace_t *trace;
+  worker_t *workers;
+  int num_workers;
+  int *done;
+} threads_t;
+
+/* Results of the replay on one number of threads */
+typedef struct {
+  double secs;
+  double ns_per_tick;
+  latency_t *lat; /* one histogram per thread */
+} threadrun_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
   /* set in read_trace */
   char filename[MAXLINE];
   int weight;
-  double ops; /* number of ops (malloc/free/realloc) in the trace */
+  double ops;      /* number of ops (malloc/free/realloc) in the trace */
+  int num_ids;     /* number of blocks */
+  int num_regions; /* number of regions */
+  int binary;      /* is it a binary trace? */
 
   /* run-time stats defined for both libc and student */
+  int allocator; /* index in allocators[] */
   int valid;   /* was the trace processed correctly by the allocator? */
-  double secs; /* number of secs needed to run the trace */
+  double secs; /* number of secs needed to run the trace (fastest run) */
+  double secs_median;      /* median of timed runs */
+  double secs_lo, secs_hi; /* 95% confidence interval of the median */
+  double samples[MAX_SAMPLES]; /* sorted times of the timed runs... */
+  int nsamples;                /* ... thinned out to at most MAX_SAMPLES */
 
   /* defined only for the student malloc package */
   double util; /* space utilization for this trace (always 0 for libc) */
   int used;    /* maximum bytes used by allocated blocks */
   int total;   /* total heap size */
+  long faults; /* page faults taken while running the trace */
+  long rss_peak;   /* largest resident heap size... */
+  double rss_mean; /* ... and its mean over the requests */
+  int reallocs; /* number of mm_realloc calls that grow the block */
+  int moves;    /* ... and how many of them moved the block */
+  long copied;  /* bytes copied by moves */
+
+  /* p50, p99, p99.9 and max latency (ns) of each request type, with -L */
+  double lat_ns[RESET + 1][4];
+
+  /* mean count of each perfctr event per request of each type, with -H */
+  double counters[RESET + 1][PERFCTR_NUM];
+  long counted[RESET + 1]; /* requests of each type counted */
+  unsigned counters_mask;  /* events that could be counted */
+  int counters_error;      /* errno of the first event that could not */
+  double counters_running; /* fraction of the time they were counting */
+
+  /* replay that touches the payloads, with -W: mean per request */
+  double touch_ns;    /* time spent touching payloads... */
+  double touch_mm_ns; /* ... and in the allocator */
+  double touch_bytes; /* bytes touched */
+  double touch_counters[PERFCTR_NUM]; /* events while touching payloads */
+  unsigned touch_mask;                /* events that could be counted */
+  int touch_walks;                    /* walks over the live blocks */
 
   /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -128,10 +284,53 @@ static randint_t random_data[RANDOM_DATA_LEN];
  * Global variables
  *******************/
 
+/* the allocator under test, one of those selected with -a */
+static const allocator_t *mm = &allocators[0];
+static int *selected; /* indices in allocators[] */
+static int num_selected;
+
 static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE } debug_mode = DBG_CHEAP;
 
 static int verbose = 1; /* global flag for verbose output */
 
+/* replay region-tagged allocations with mm_region_* instead of mm_malloc */
+static int region_mode = 0;
+
+/* timed runs of each speed test, preceded by untimed warmup runs */
+static int timing_reps = 1;
+static int timing_warmup = 0;
+
+/* time every operation and keep a histogram per request type */
+static int latency_mode = 0;
+static latency_t latency[RESET + 1];
+static double ns_per_tick;
+
+/* sample the heap every series_every requests into series_file (CSV) */
+static FILE *series_file = NULL;
+static int series_every = 1000;
+
+/* replay traces on 1..max_threads threads, see eval_threads */
+static int max_threads = 0;
+static int recorded_threads;
+static threadrun_t *thread_runs;
+
+/* read hardware counters around every request */
+static int counter_mode = 0;
+
+/* touch payloads and walk the live blocks every touch_every requests */
+static int touch_every = 0;
+
+/* write the results to a baseline file, or compare them with one */
+static const char *baseline_out = NULL;
+static const char *baseline_in = NULL;
+
+/* print results as a table, or one JSON or CSV record per trace */
+static enum { OUT_TABLE, OUT_JSON, OUT_CSV } output = OUT_TABLE;
+
+/* mm.c is not thread safe, threads call allocators of the simulated heap
+   under this lock */
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*********************
  * Function prototypes
  *********************/
@@ -141,6 +340,7 @@ static int add_range(range_t **ranges, char *lo, int size, const trace_t *trace,
                      int opnum, int index);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static void sample_heap(const range_t *ranges, int opnum);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
@@ -149,6 +349,9 @@ static void randomize_block(trace_t *trace, int index);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(stats_t *stats, const char *filename);
+static trace_t *read_bintrace(stats_t *stats, const char *filename, int fd);
+static void alloc_blocks(trace_t *trace);
+static void link_regions(trace_t *trace);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
 
@@ -159,11 +362,25 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int *used_p, int *total_p);
+static double eval_mm_util(trace_t *trace, stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace);
+static void save_latency(stats_t *stats);
+static void eval_mm_counters(trace_t *trace, stats_t *stats);
+static void eval_mm_touch(trace_t *trace, stats_t *stats);
+static void eval_threads(trace_t *trace);
 
 /* Various helper routines */
 static void printresults(stats_t *stats);
+static void printrow(stats_t *stats);
+static void printtiming(stats_t *stats, int cpu);
+static void printlatency(stats_t *stats);
+static void printthreads(void);
+static void printcounters(stats_t *stats);
+static void printtouch(stats_t *stats);
+static void printrecord(stats_t *stats, int first);
+static void printcompare(stats_t *stats, int num);
+static int check_baseline(stats_t *stats, int num);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
   __attribute__((format(printf, 3, 4)));
@@ -179,62 +396,348 @@ static void app_error(const char *fmt, ...)
 typedef void (*fsecs_test_funct)(void *);
 
 /*
- * fsecs - Return the running time of a function f (in seconds)
+ * now - Read a clock that is not subject to NTP adjustments (in seconds)
+ */
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * fsecs - Run f timing_warmup times, then time it timing_reps times.
+ *     Return the fastest run (in seconds) and fill in the median and its
+ *     95% distribution-free confidence interval, whose bounds are the
+ *     order statistics around n/2 +- 0.98 sqrt(n).
+ */
+static double fsecs(fsecs_test_funct f, void *argp, stats_t *stats) {
+  int n = timing_reps;
+  double *t;
+
+  if ((t = malloc(n * sizeof(double))) == NULL)
+    unix_error("malloc failed in fsecs");
+
+  for (int i = 0; i < timing_warmup; i++)
+    f(argp);
+
+  for (int i = 0; i < n; i++) {
+    double start = now();
+    f(argp);
+    t[i] = now() - start;
+  }
+
+  qsort(t, n, sizeof(double), cmp_double);
+
+  int lo = floor((n - 1.96 * sqrt(n)) / 2) - 1;
+  int hi = ceil(1 + (n + 1.96 * sqrt(n)) / 2) - 1;
+
+  stats->secs_median = n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+  stats->secs_lo = t[lo < 0 ? 0 : lo];
+  stats->secs_hi = t[hi >= n ? n - 1 : hi];
+
+  stats->nsamples = n < MAX_SAMPLES ? n : MAX_SAMPLES;
+  for (int i = 0; i < stats->nsamples; i++)
+    stats->samples[i] = t[(long)i * n / stats->nsamples];
+
+  double best = t[0];
+  free(t);
+  return best;
+}
+
+/*
+ * pin_cpu - Keep the driver on one CPU so that runs see the same caches
  */
-static double fsecs(fsecs_test_funct f, void *argp) {
-  struct timeval stv, etv;
-  double diff;
+static void pin_cpu(int cpu) {
+  cpu_set_t set;
 
-  gettimeofday(&stv, NULL);
-  f(argp);
-  gettimeofday(&etv, NULL);
-  diff = 1E3 * (etv.tv_sec - stv.tv_sec) + 1E-3 * (etv.tv_usec - stv.tv_usec);
-  return (1E-3 * diff);
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    unix_error("Could not pin to CPU %d", cpu);
 }
 
-/* Run the tests; return the number of tests run (may be less than
-   num_tracefiles, if there's a timeout) */
-static void run_tests(char *tracefile, stats_t *mm_stats, range_t *ranges,
+/* Run the tests of the allocator mm, whose heap is memlib's */
+static void run_tests(trace_t *trace, stats_t *mm_stats, range_t **ranges,
                       speed_t *speed_params) {
   /* initialize simulated memory system in memlib.c *
    * start each trace with a clean system */
   mem_init();
 
-  trace_t *trace;
-  trace = read_trace(mm_stats, tracefile);
-  strcpy(mm_stats->filename, trace->filename);
-  mm_stats->ops = trace->num_ops;
   if (verbose > 1)
-    printf("Checking mm_malloc for correctness, ");
-  mm_stats->valid = eval_mm_valid(trace, &ranges);
+    printf("Checking %s_malloc for correctness, ", mm->name);
+  mm_stats->valid = eval_mm_valid(trace, ranges);
 
   if (mm_stats->valid) {
     if (verbose > 1)
       printf("efficiency, ");
-    mm_stats->util = eval_mm_util(trace, &mm_stats->used, &mm_stats->total);
+    mm_stats->util = eval_mm_util(trace, mm_stats);
     speed_params->trace = trace;
-    speed_params->ranges = ranges;
+    speed_params->ranges = *ranges;
     if (verbose > 1)
       printf("and performance.\n");
-    mm_stats->secs = fsecs(eval_mm_speed, speed_params);
+    mm_stats->secs = fsecs(eval_mm_speed, speed_params, mm_stats);
+    if (latency_mode) {
+      eval_mm_latency(trace);
+      save_latency(mm_stats);
+    }
+    if (counter_mode)
+      eval_mm_counters(trace, mm_stats);
+    if (touch_every)
+      eval_mm_touch(trace, mm_stats);
+    if (max_threads)
+      eval_threads(trace);
   }
-
-  free_trace(trace);
+  mm_stats->faults = mem_pagefaults();
 
   /* clean up memory system */
   mem_deinit();
 }
 
+/*
+ * run_libc_tests - Check that libc malloc can run the trace and time it
+ */
+static void run_libc_tests(trace_t *trace, stats_t *libc_stats) {
+  speed_t speed_params;
+
+  libc_stats->valid = eval_libc_valid(trace);
+  if (libc_stats->valid) {
+    speed_params.trace = trace;
+    libc_stats->secs = fsecs(eval_libc_speed, &speed_params, libc_stats);
+    if (max_threads)
+      eval_threads(trace);
+  }
+}
+
+/*
+ * evaluate - Read a trace and run it with every selected allocator, filling
+ *     in one stats_t for each of them
+ */
+static void evaluate(const char *tracefile, stats_t *stats, range_t **ranges) {
+  speed_t speed_params;
+  stats_t base;
+
+  memset(&base, 0, sizeof(base));
+  trace_t *trace = read_trace(&base, tracefile);
+
+  for (int k = 0; k < num_selected; k++) {
+    mm = &allocators[selected[k]];
+    stats[k] = base;
+    stats[k].allocator = selected[k];
+    if (verbose > 1)
+      printf("\nTesting %s malloc\n", mm->name);
+    if (mm->sim_heap)
+      run_tests(trace, &stats[k], ranges, &speed_params);
+    else
+      run_libc_tests(trace, &stats[k]);
+  }
+
+  free_trace(trace);
+}
+
+/*
+ * select_allocator - Add an allocator to those evaluated, "all" adds all
+ */
+static void select_allocator(const char *name) {
+  for (int i = 0; i < num_allocators; i++) {
+    if (strcmp(name, "all") && strcmp(name, allocators[i].name))
+      continue;
+    if (!(selected = realloc(selected, (num_selected + 1) * sizeof(int))))
+      unix_error("realloc failed in select_allocator");
+    selected[num_selected++] = i;
+    if (strcmp(name, "all"))
+      return;
+  }
+  if (strcmp(name, "all"))
+    app_error("Unknown allocator '%s'\n", name);
+}
+
+/*
+ * add_tracefile - Append a trace file name to the list of traces to run
+ */
+static void add_tracefile(char ***tracefiles, int *num, const char *name) {
+  if (!(*tracefiles = realloc(*tracefiles, (*num + 1) * sizeof(char *))))
+    unix_error("realloc failed in add_tracefile");
+  (*tracefiles)[(*num)++] = strdup(name);
+}
+
+static int cmp_name(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * add_tracedir - Append all *.rep and *.bin files found in a directory,
+ *     sorted by name
+ */
+static void add_tracedir(char ***tracefiles, int *num, const char *dir) {
+  DIR *d;
+  struct dirent *de;
+  char path[MAXLINE];
+  int first = *num;
+
+  if ((d = opendir(dir)) == NULL)
+    unix_error("Could not open directory %s", dir);
+  while ((de = readdir(d)) != NULL) {
+    size_t len = strlen(de->d_name);
+    if (len < 4 || (strcmp(de->d_name + len - 4, ".rep") &&
+                    strcmp(de->d_name + len - 4, ".bin")))
+      continue;
+    snprintf(path, MAXLINE, "%s/%s", dir, de->d_name);
+    add_tracefile(tracefiles, num, path);
+  }
+  closedir(d);
+
+  qsort(*tracefiles + first, *num - first, sizeof(char *), cmp_name);
+}
+
+/*
+ * run_suite - Evaluate many traces, each in a forked worker with its own
+ *     heap, running up to jobs workers at a time. Workers send their stats,
+ *     one per selected allocator, back through a pipe; a worker that dies
+ *     counts as an invalid trace. Prints one row per trace and the totals
+ *     computed as in grade.py.
+ */
+static int run_suite(char **tracefiles, int num, int jobs) {
+  int n = num_selected;
+  size_t len = n * sizeof(stats_t);
+  stats_t *stats;
+  pid_t *pids;
+  int *fds;
+  int next = 0, running = 0;
+
+  if (!(stats = calloc(num, len)) || !(pids = calloc(num, sizeof(pid_t))) ||
+      !(fds = calloc(num, sizeof(int))))
+    unix_error("calloc failed in run_suite");
+
+  while (next < num || running > 0) {
+    /* Start workers while there are idle cores */
+    while (running < jobs && next < num) {
+      int fd[2];
+      if (pipe(fd) < 0)
+        unix_error("pipe failed in run_suite");
+      if ((pids[next] = fork()) < 0)
+        unix_error("fork failed in run_suite");
+
+      if (pids[next] == 0) {
+        stats_t *st = &stats[next * n];
+        range_t *ranges = NULL;
+        int valid = 1;
+
+        close(fd[0]);
+        evaluate(tracefiles[next], st, &ranges);
+        if (write(fd[1], st, len) != (ssize_t)len)
+          unix_error("write failed in run_suite");
+        for (int k = 0; k < n; k++)
+          valid &= st[k].valid;
+        _exit(valid ? EXIT_SUCCESS : EXIT_FAILURE);
+      }
+
+      close(fd[1]);
+      fds[next++] = fd[0];
+      running++;
+    }
+
+    /* Collect a finished worker */
+    int status;
+    pid_t pid = wait(&status);
+    if (pid < 0)
+      unix_error("wait failed in run_suite");
+
+    for (int i = 0; i < next; i++) {
+      if (pids[i] != pid)
+        continue;
+      stats_t *st = &stats[i * n];
+      if (read(fds[i], st, len) != (ssize_t)len) {
+        memset(st, 0, len);
+        for (int k = 0; k < n; k++) {
+          st[k].weight = WALL;
+          st[k].allocator = selected[k];
+        }
+      }
+      for (int k = 0; k < n; k++)
+        strncpy(st[k].filename, tracefiles[i], MAXLINE - 1);
+      close(fds[i]);
+      running--;
+      break;
+    }
+  }
+
+  double ops = 0, valid_ops = 0, util = 0, secs = 0;
+  long used = 0, total = 0, rss = 0;
+  int valid = 0;
+
+  if (output != OUT_TABLE) {
+    for (int i = 0; i < num * n; i++) {
+      printrecord(&stats[i], i == 0);
+      valid += stats[i].valid;
+    }
+    goto done;
+  }
+
+  if (n > 1) {
+    printcompare(stats, num);
+    for (int i = 0; i < num * n; i++)
+      valid += stats[i].valid;
+    goto done;
+  }
+
+  printf("\nResults for %s malloc:\n", mm->name);
+  printf("  %2s%6s%8s%8s %5s%8s%10s  %s\n", "valid", "util", "used", "total",
+         "ops", "secs", "Kops", "trace");
+  for (int i = 0; i < num; i++) {
+    printrow(&stats[i]);
+    ops += stats[i].ops;
+    if (!stats[i].valid)
+      continue;
+    valid++;
+    valid_ops += stats[i].ops;
+    util += stats[i].util * stats[i].ops;
+    used += stats[i].used;
+    total += stats[i].total;
+    rss += stats[i].rss_peak;
+    secs += stats[i].secs;
+  }
+
+  printf("%d of %d traces valid\n", valid, num);
+  if (mm->sim_heap) {
+    printf("Weighted memory utilization: %.1f%%\n", 100.0 * util / ops);
+    printf("Total memory utilization: %.2f%%\n",
+           total ? 100.0 * used / total : 0.0);
+    printf("Total resident utilization: %.2f%%\n",
+           rss ? 100.0 * used / rss : 0.0);
+  }
+  /* like grade.py, utilization counts invalid traces as 0%, but only valid
+     traces were timed */
+  printf("Throughput: %.0f Kops\n", secs > 0 ? valid_ops / 1e3 / secs : 0.0);
+
+done:
+  if (check_baseline(stats, num * n))
+    valid = 0;
+  free(stats);
+  free(pids);
+  free(fds);
+  return valid == num * n ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 /**************
  * Main routine
  **************/
 int main(int argc, char **argv) {
-  char *tracefile = NULL; /* trace file names */
-  range_t *ranges = NULL; /* keeps track of block extents for one trace */
-  stats_t libc_stats;     /* libc stats for trace */
-  stats_t mm_stats;       /* mm (i.e. student) stats for trace */
-  speed_t speed_params;   /* input parameters to the xx_speed routines */
-  int run_libc = 0;       /* If set, run libc malloc (set by -l) */
+  char **tracefiles = NULL; /* trace file names */
+  int num_tracefiles = 0;   /* ... and how many of them */
+  range_t *ranges = NULL;   /* keeps track of block extents for one trace */
+  stats_t *stats;           /* stats of each selected allocator */
+
+  mem_backend_t backend = MEM_SIM; /* Heap backing store (set by -b) */
+  int mem_flags = 0;               /* Set by -P and -A */
+  int cpu = -1;                    /* CPU to run on (set by -c) */
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN); /* Workers (set by -j) */
+  int reps_set = 0;                         /* Set by -k and -w */
 
   setbuf(stdout, 0);
   setbuf(stderr, 0);
@@ -243,14 +746,28 @@ int main(int argc, char **argv) {
    * Read and interpret the command line arguments
    */
   char c;
-  while ((c = getopt(argc, argv, "d:f:v:hVlD")) != EOF) {
+  while ((c = getopt(argc, argv,
+                     "a:b:c:d:e:f:j:k:t:u:v:w:B:C:O:T:W:hVlDHLRPA")) != EOF) {
     switch (c) {
-      case 'f': /* Use one specific trace file only (relative to curr dir) */
-        tracefile = strdup(optarg);
+      case 'f': /* Use a specific trace file (relative to curr dir) */
+        add_tracefile(&tracefiles, &num_tracefiles, optarg);
+        break;
+
+      case 't': /* Use all trace files in a directory */
+        add_tracedir(&tracefiles, &num_tracefiles, optarg);
+        break;
+
+      case 'j': /* Number of traces run in parallel */
+        if ((jobs = atoi(optarg)) < 1)
+          app_error("Number of jobs must be positive\n");
         break;
 
       case 'l': /* Run libc malloc */
-        run_libc = 1;
+        select_allocator("libc");
+        break;
+
+      case 'a': /* Run an allocator linked into the driver */
+        select_allocator(optarg);
         break;
 
       case 'V': /* Increase verbosity level */
@@ -269,6 +786,91 @@ int main(int argc, char **argv) {
         debug_mode = DBG_EXPENSIVE;
         break;
 
+      case 'L': /* Measure latency of each request */
+        latency_mode = 1;
+        break;
+
+      case 'H': /* Read hardware counters around each request */
+        counter_mode = 1;
+        break;
+
+      case 'O': /* Print machine-readable records */
+        if (!strcmp(optarg, "json"))
+          output = OUT_JSON;
+        else if (!strcmp(optarg, "csv"))
+          output = OUT_CSV;
+        else
+          app_error("Unknown output format '%s'\n", optarg);
+        break;
+
+      case 'u': /* Write a heap time series */
+        if ((series_file = fopen(optarg, "w")) == NULL)
+          unix_error("Could not create %s", optarg);
+        fprintf(series_file, "op,live,heap,free,largest,frag\n");
+        break;
+
+      case 'e': /* Heap sampling interval */
+        if ((series_every = atoi(optarg)) < 1)
+          app_error("Sampling interval must be positive\n");
+        break;
+
+      case 'T': /* Replay on 1..n threads */
+        if ((max_threads = atoi(optarg)) < 1)
+          app_error("Number of threads must be positive\n");
+        break;
+
+      case 'R': /* Use regions for region-tagged allocations */
+        region_mode = 1;
+        break;
+
+      case 'b': /* Select memlib backend */
+        if (!strcmp(optarg, "sim"))
+          backend = MEM_SIM;
+        else if (!strcmp(optarg, "hugetlb"))
+          backend = MEM_HUGETLB;
+        else if (!strcmp(optarg, "thp"))
+          backend = MEM_THP;
+        else
+          app_error("Unknown heap backend '%s'\n", optarg);
+        break;
+
+      case 'P': /* Pre-fault the heap */
+        mem_flags |= MEM_POPULATE;
+        break;
+
+      case 'A': /* Grow the heap by backing pages */
+        mem_flags |= MEM_ALIGN_GROWTH;
+        break;
+
+      case 'k': /* Number of timed runs */
+        if ((timing_reps = atoi(optarg)) < 1)
+          app_error("Number of timed runs must be positive\n");
+        reps_set = 1;
+        break;
+
+      case 'w': /* Number of warmup runs */
+        if ((timing_warmup = atoi(optarg)) < 0)
+          app_error("Number of warmup runs must not be negative\n");
+        reps_set = 1;
+        break;
+
+      case 'W': /* Touch payloads */
+        if ((touch_every = atoi(optarg)) < 1)
+          app_error("Live blocks must be walked every 1 or more requests\n");
+        break;
+
+      case 'B': /* Write a baseline */
+        baseline_out = optarg;
+        break;
+
+      case 'C': /* Compare with a baseline */
+        baseline_in = optarg;
+        break;
+
+      case 'c': /* Pin to a CPU */
+        cpu = atoi(optarg);
+        break;
+
       case 'h': /* Print this message */
         usage();
         exit(EXIT_SUCCESS);
@@ -279,7 +881,11 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (tracefile == NULL) {
+  /* Remaining arguments are trace files too */
+  for (int i = optind; i < argc; i++)
+    add_tracefile(&tracefiles, &num_tracefiles, argv[i]);
+
+  if (num_tracefiles == 0) {
     usage();
     exit(EXIT_FAILURE);
   }
@@ -287,56 +893,119 @@ int main(int argc, char **argv) {
   if (debug_mode != DBG_NONE)
     init_random_data();
 
-  if (run_libc) {
-    /*
-     * Run and evaluate the libc malloc package
-     */
-    if (verbose > 1)
-      printf("\nTesting libc malloc\n");
-
-    /* Evaluate the libc malloc package using the K-best scheme */
-    trace_t *trace = read_trace(&libc_stats, tracefile);
+  mem_configure(backend, mem_flags);
 
-    libc_stats.valid = eval_libc_valid(trace);
-    if (libc_stats.valid) {
-      speed_params.trace = trace;
-      libc_stats.secs = fsecs(eval_libc_speed, &speed_params);
-    }
-    free_trace(trace);
+  if (cpu >= 0)
+    pin_cpu(cpu);
 
-    /* Display the libc results in a compact table */
-    if (verbose) {
-      printf("\nResults for libc malloc:\n");
-      printresults(&libc_stats);
+  /* baselines need a distribution of times and the instruction counts */
+  if (baseline_out || baseline_in) {
+    if (!reps_set) {
+      timing_reps = BASELINE_RUNS;
+      timing_warmup = BASELINE_WARMUP;
     }
-
-    return libc_stats.valid ? EXIT_SUCCESS : EXIT_FAILURE;
+    counter_mode = 1;
   }
 
-  /*
-   * Run and evaluate the student's mm package
-   */
-  if (verbose > 1)
-    printf("\nTesting mm malloc\n");
-
-  /* Allocate the mm stats array, with one stats_t struct per tracefile */
-  run_tests(tracefile, &mm_stats, ranges, &speed_params);
-
-  /* Display the mm results */
-  if (verbose) {
-    printf("\nResults for mm malloc:\n");
-    printresults(&mm_stats);
+  if (num_selected == 0)
+    select_allocator(allocators[0].name);
+  mm = &allocators[selected[0]];
+
+  if (num_tracefiles > 1 && max_threads)
+    app_error("Threaded replay (-T) takes a single trace\n");
+  if (num_tracefiles > 1 && series_file)
+    app_error("Heap time series (-u) take a single trace\n");
+  if (num_selected > 1 && (max_threads || series_file))
+    app_error("-T and -u take a single allocator\n");
+  for (int k = 0; k < num_selected; k++)
+    if (region_mode && selected[k] != 0 && allocators[selected[k]].sim_heap)
+      app_error("Regions (-R) are allocated with %s\n", allocators[0].name);
+
+  if (num_tracefiles > 1)
+    return run_suite(tracefiles, num_tracefiles, jobs);
+
+  if (!(stats = calloc(num_selected, sizeof(stats_t))))
+    unix_error("calloc failed in main");
+  evaluate(tracefiles[0], stats, &ranges);
+
+  int valid = 1;
+  for (int k = 0; k < num_selected; k++)
+    valid &= stats[k].valid;
+
+  if (output != OUT_TABLE) {
+    for (int k = 0; k < num_selected; k++)
+      printrecord(&stats[k], k == 0);
+  } else if (num_selected > 1) {
+    printcompare(stats, 1);
+  } else if (verbose) {
+    /* Display the results in a compact table */
+    printf("\nResults for %s malloc:\n", mm->name);
+    printresults(stats);
+    printtiming(stats, cpu);
+    if (latency_mode && stats->valid && mm->sim_heap)
+      printlatency(stats);
+    if (counter_mode && stats->valid && mm->sim_heap)
+      printcounters(stats);
+    if (touch_every && stats->valid && mm->sim_heap)
+      printtouch(stats);
+    if (max_threads && stats->valid)
+      printthreads();
+    if (mm->sim_heap) {
+      printf("Heap backend %s with %zu KiB pages: %ld page faults\n",
+             mem_backend_name(), mem_backing_pagesize() >> 10, stats->faults);
+      printf("Resident heap: peak %ld KiB, mean %.0f KiB, utilization %.1f%% "
+             "(%.1f%% of brk)\n",
+             stats->rss_peak >> 10, stats->rss_mean / 1024,
+             stats->rss_peak ? 100.0 * stats->used / stats->rss_peak : 0.0,
+             100 * stats->util);
+      if (stats->reallocs)
+        printf("Growing realloc moved %d of %d blocks, %ld bytes copied\n",
+               stats->moves, stats->reallocs, stats->copied);
+    }
   }
 
-  return mm_stats.valid ? EXIT_SUCCESS : EXIT_FAILURE;
+  if (check_baseline(stats, num_selected))
+    valid = 0;
+  return valid ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /*****************************************************************
  * The following routines manipulate the range list, which keeps
  * track of the extent of every allocated block payload. We use the
  * range list to detect any overlapping allocated blocks.
+ *
+ * The list is a skip list ordered by payload address, so that checking
+ * and removing a range takes O(log n) expected time.
  ****************************************************************/
 
+/*
+ * range_seek - Find the last range starting below lo on every level
+ *     and store it in update. Returns the last such range on level 0.
+ */
+static range_t *range_seek(range_t *head, char *lo, range_t **update) {
+  range_t *x = head;
+
+  for (int l = RANGE_LEVELS - 1; l >= 0; l--) {
+    while (x->next[l] != NULL && x->next[l]->lo < lo)
+      x = x->next[l];
+    update[l] = x;
+  }
+  return x;
+}
+
+/*
+ * range_height - Pick the number of links of a new range, such that
+ *     each level has half as many ranges as the one below it.
+ */
+static int range_height(void) {
+  static unsigned state = 2463534242u;
+
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return __builtin_ctz(state | (1u << (RANGE_LEVELS - 1))) + 1;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of
@@ -364,34 +1033,43 @@ static int add_range(range_t **ranges, char *lo, int size, const trace_t *trace,
     return 0;
   }
 
-  /* If we can't afford the linear-time loop, we check less thoroughly and
-     just assume the overlap will be caught by writing random bits. */
-  if (trace->ignore_ranges || debug_mode == DBG_NONE)
+  /* heap samples need the ranges even if we don't check them */
+  if (debug_mode == DBG_NONE && series_file == NULL)
     return 1;
 
-  /* The payload must not overlap any other payloads */
-  range_t *p;
+  /*
+   * The payload must not overlap any other payloads. Ranges in the list are
+   * disjoint, so only its neighbours in address order have to be checked.
+   */
+  range_t *update[RANGE_LEVELS];
+  range_t *p = range_seek(*ranges, lo, update);
+  range_t *q = p->next[0];
 
-  for (p = *ranges; p != NULL; p = p->next) {
-    if ((lo >= p->lo && lo <= p->hi) || (hi >= p->lo && hi <= p->hi)) {
-      malloc_error(trace, opnum,
-                   "Payload (%p:%p) overlaps another payload (%p:%p)\n", lo, hi,
-                   p->lo, p->hi);
-      return 0;
-    }
+  if (p != *ranges && p->hi >= lo)
+    q = p;
+  if (q != NULL && q->lo <= hi && q->hi >= lo) {
+    malloc_error(trace, opnum,
+                 "Payload (%p:%p) overlaps another payload (%p:%p)\n", lo, hi,
+                 q->lo, q->hi);
+    return 0;
   }
 
   /*
    * Everything looks OK, so remember the extent of this block
    * by creating a range struct and adding it the range list.
    */
-  if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
+  int height = range_height();
+
+  if ((p = malloc(sizeof(range_t) + height * sizeof(range_t *))) == NULL)
     unix_error("malloc error in add_range");
-  p->next = *ranges;
   p->lo = lo;
   p->hi = hi;
   p->index = index;
-  *ranges = p;
+  p->height = height;
+  for (int l = 0; l < height; l++) {
+    p->next[l] = update[l]->next[l];
+    update[l]->next[l] = p;
+  }
 
   return 1;
 }
@@ -400,29 +1078,63 @@ static int add_range(range_t **ranges, char *lo, int size, const trace_t *trace,
  * remove_range - Free the range record of block whose payload starts at lo
  */
 static void remove_range(range_t **ranges, char *lo) {
-  range_t **prevpp = ranges;
+  range_t *update[RANGE_LEVELS];
+  range_t *p = range_seek(*ranges, lo, update)->next[0];
 
-  for (range_t *p = *ranges; p != NULL; p = p->next) {
-    if (p->lo == lo) {
-      *prevpp = p->next;
-      free(p);
-      break;
-    }
-    prevpp = &(p->next);
-  }
+  if (p == NULL || p->lo != lo)
+    return;
+
+  for (int l = 0; l < p->height; l++)
+    update[l]->next[l] = p->next[l];
+  free(p);
 }
 
 /*
- * clear_ranges - free all of the range records for a trace
+ * clear_ranges - free all of the range records for a trace; the list head
+ *     is allocated on first use
  */
 static void clear_ranges(range_t **ranges) {
   range_t *pnext;
 
-  for (range_t *p = *ranges; p != NULL; p = pnext) {
-    pnext = p->next;
+  if (*ranges == NULL) {
+    size_t headsz = sizeof(range_t) + RANGE_LEVELS * sizeof(range_t *);
+    if ((*ranges = calloc(1, headsz)) == NULL)
+      unix_error("malloc error in clear_ranges");
+    (*ranges)->height = RANGE_LEVELS;
+    return;
+  }
+
+  for (range_t *p = (*ranges)->next[0]; p != NULL; p = pnext) {
+    pnext = p->next[0];
     free(p);
   }
-  *ranges = NULL;
+  for (int l = 0; l < RANGE_LEVELS; l++)
+    (*ranges)->next[l] = NULL;
+}
+
+/*
+ * sample_heap - Write a row of the heap time series after request opnum.
+ *     Allocators can't be asked about their free blocks, so the heap is seen
+ *     from the payloads: everything between live payloads counts as free, and
+ *     the largest gap stands for the largest free block. The fragmentation
+ *     index is 1 - largest / free, 0 when all free space is in one piece.
+ */
+static void sample_heap(const range_t *ranges, int opnum) {
+  char *lo = mem_heap_lo(), *hi = (char *)mem_heap_hi() + 1;
+  size_t live = 0, largest = 0;
+
+  for (const range_t *r = ranges->next[0]; r != NULL; r = r->next[0]) {
+    if ((size_t)(r->lo - lo) > largest)
+      largest = r->lo - lo;
+    live += r->hi - r->lo + 1;
+    lo = r->hi + 1;
+  }
+  if (hi > lo && (size_t)(hi - lo) > largest)
+    largest = hi - lo;
+
+  size_t heap = mem_heapsize(), unused = heap - live;
+  fprintf(series_file, "%d,%zu,%zu,%zu,%zu,%.4f\n", opnum, live, heap, unused,
+          largest, unused ? 1 - (double)largest / unused : 0.0);
 }
 
 /**********************************************
@@ -494,8 +1206,19 @@ static trace_t *read_trace(stats_t *stats, const char *filename) {
   if (verbose > 1)
     printf("Reading tracefile: %s\n", filename);
 
+  /* Binary traces start with a magic number */
+  int fd;
+  uint32_t magic = 0;
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    unix_error("Could not open %s in read_trace", filename);
+  if (read(fd, &magic, sizeof(magic)) == sizeof(magic) &&
+      magic == TRACEBIN_MAGIC)
+    return read_bintrace(stats, filename, fd);
+  close(fd);
+
   /* Allocate the trace record */
-  if (!(trace = (trace_t *)malloc(sizeof(trace_t))))
+  if (!(trace = (trace_t *)calloc(1, sizeof(trace_t))))
     unix_error("malloc 1 failed in read_trace");
 
   /* Read the trace file header */
@@ -517,19 +1240,9 @@ static trace_t *read_trace(stats_t *stats, const char *filename) {
   /* We'll store each request line in the trace in this array */
   if (!(trace->ops = (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))))
     unix_error("malloc 2 failed in read_trace");
+  trace->chunk_len = trace->num_ops;
 
-  /* We'll keep an array of pointers to the allocated blocks here... */
-  if (!(trace->blocks = (char **)calloc(trace->num_ids, sizeof(char *))))
-    unix_error("malloc 3 failed in read_trace");
-
-  /* ... along with the corresponding byte sizes of each block */
-  if (!(trace->block_sizes = (size_t *)calloc(trace->num_ids, sizeof(size_t))))
-    unix_error("malloc 4 failed in read_trace");
-
-  /* and, if we're debugging, the offset into the random data */
-  if (!(trace->block_rand_base =
-          calloc(trace->num_ids, sizeof(*trace->block_rand_base))))
-    unix_error("malloc 5 failed in read_trace");
+  alloc_blocks(trace);
 
   /* read every request line in the trace file */
   int index = 0;
@@ -537,6 +1250,7 @@ static trace_t *read_trace(stats_t *stats, const char *filename) {
   int max_index = 0;
   char type[MAXLINE];
   int size;
+  int region;
 
   while (fscanf(tracefile, "%s", type) != EOF) {
     switch (type[0]) {
@@ -562,6 +1276,25 @@ static trace_t *read_trace(stats_t *stats, const char *filename) {
         trace->ops[op_index].index = index;
         break;
 
+      case 'A':
+        ignore += fscanf(tracefile, "%u %u %u", &region, &index, &size);
+        trace->ops[op_index].type = RALLOC;
+        trace->ops[op_index].index = index;
+        trace->ops[op_index].size = size;
+        trace->block_region[index] = region;
+        max_index = (index > max_index) ? index : max_index;
+        if (region >= trace->num_regions)
+          trace->num_regions = region + 1;
+        break;
+
+      case 'x':
+        ignore += fscanf(tracefile, "%u", &region);
+        trace->ops[op_index].type = RESET;
+        trace->ops[op_index].index = region;
+        if (region >= trace->num_regions)
+          trace->num_regions = region + 1;
+        break;
+
       default:
         app_error("Bogus type character (%c) in tracefile %s\n", type[0],
                   trace->filename);
@@ -575,79 +1308,412 @@ static trace_t *read_trace(stats_t *stats, const char *filename) {
   assert(max_index == trace->num_ids - 1);
   assert(trace->num_ops == op_index);
 
+  if (trace->num_regions > 0)
+    link_regions(trace);
+
   /* fill in the stats */
   strcpy(stats->filename, trace->filename);
   stats->weight = trace->weight;
   stats->ops = trace->num_ops;
+  stats->num_ids = trace->num_ids;
+  stats->num_regions = trace->num_regions;
+  stats->binary = trace->map != NULL;
 
   return trace;
 }
 
 /*
- * reinit_trace - get the trace ready for another run.
+ * alloc_blocks - Allocate the per-block arrays of a trace
  */
-static void reinit_trace(trace_t *trace) {
-  memset(trace->blocks, 0, trace->num_ids * sizeof(*trace->blocks));
-  memset(trace->block_sizes, 0, trace->num_ids * sizeof(*trace->block_sizes));
-  /* block_rand_base is unused if size is zero */
-}
+static void alloc_blocks(trace_t *trace) {
+  /* We'll keep an array of pointers to the allocated blocks here... */
+  if (!(trace->blocks = (char **)calloc(trace->num_ids, sizeof(char *))))
+    unix_error("malloc 3 failed in alloc_blocks");
 
-/*
- * free_trace - Free the trace record and the four arrays it points
- *              to, all of which were allocated in read_trace().
- */
-static void free_trace(trace_t *trace) {
-  free(trace->ops); /* free the three arrays... */
-  free(trace->blocks);
-  free(trace->block_sizes);
-  free(trace->block_rand_base);
-  free(trace); /* and the trace record itself... */
-}
+  /* ... along with the corresponding byte sizes of each block */
+  if (!(trace->block_sizes = (size_t *)calloc(trace->num_ids, sizeof(size_t))))
+    unix_error("malloc 4 failed in alloc_blocks");
 
-/**********************************************************************
- * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
- **********************************************************************/
+  /* and, if we're debugging, the offset into the random data */
+  if (!(trace->block_rand_base =
+          calloc(trace->num_ids, sizeof(*trace->block_rand_base))))
+    unix_error("malloc 5 failed in alloc_blocks");
+
+  /* and the region each block belongs to */
+  if (!(trace->block_region = malloc(trace->num_ids * sizeof(int))))
+    unix_error("malloc 6 failed in alloc_blocks");
+  memset(trace->block_region, -1, trace->num_ids * sizeof(int));
+}
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * read_bintrace - Map a binary trace whose magic number was read from fd.
+ *     Requests are decoded OPS_CHUNK at a time by load_chunk, so memory use
+ *     does not depend on the length of the trace.
  */
-static int eval_mm_valid(trace_t *trace, range_t **ranges) {
+static trace_t *read_bintrace(stats_t *stats, const char *filename, int fd) {
+  struct stat st;
+  trace_t *trace;
+  const tracebin_hdr_t *hdr;
+
+  if (fstat(fd, &st) < 0)
+    unix_error("Could not stat %s in read_bintrace", filename);
+  if ((size_t)st.st_size < sizeof(tracebin_hdr_t))
+    app_error("%s: truncated header", filename);
+
+  const void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    unix_error("Could not map %s in read_bintrace", filename);
+  close(fd);
+  madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+  hdr = map;
+  if (hdr->version != TRACEBIN_VERSION)
+    app_error("%s: unsupported version %u", filename, hdr->version);
+  if (hdr->weight > 3)
+    app_error("%s: weight can only be in {0, 1, 2, 3}", filename);
+  if (hdr->num_ops > INT_MAX || hdr->num_ids > INT_MAX ||
+      hdr->num_regions > INT_MAX)
+    app_error("%s: too many requests", filename);
+
+  if (!(trace = calloc(1, sizeof(trace_t))))
+    unix_error("malloc 1 failed in read_bintrace");
+  strcpy(trace->filename, filename);
+  trace->weight = hdr->weight;
+  trace->num_ids = hdr->num_ids;
+  trace->num_ops = hdr->num_ops;
+  trace->num_regions = hdr->num_regions;
+  trace->map = map;
+  trace->maplen = st.st_size;
+  trace->flags = hdr->flags;
+
+  if (!(trace->ops = malloc(OPS_CHUNK * sizeof(traceop_t))))
+    unix_error("malloc 2 failed in read_bintrace");
+  if ((trace->flags & TRACEBIN_THREADS) &&
+      !(trace->op_threads = malloc(OPS_CHUNK * sizeof(int))))
+    unix_error("malloc 2 failed in read_bintrace");
+  alloc_blocks(trace);
+
+  if (trace->num_regions > 0) {
+    if (!(trace->regions = calloc(trace->num_regions, sizeof(mm_region_t *))))
+      unix_error("malloc 3 failed in read_bintrace");
+    if (!(trace->region_head = malloc(trace->num_regions * sizeof(int))) ||
+        !(trace->region_next = malloc(trace->num_ids * sizeof(int))) ||
+        !(trace->live = malloc(trace->num_ids)))
+      unix_error("malloc 4 failed in read_bintrace");
+  }
+
+  /* fill in the stats */
+  strcpy(stats->filename, trace->filename);
+  stats->weight = trace->weight;
+  stats->ops = trace->num_ops;
+  stats->num_ids = trace->num_ids;
+  stats->num_regions = trace->num_regions;
+  stats->binary = trace->map != NULL;
+
+  return trace;
+}
+
+/*
+ * push_reset_id - Append to the reset lists of the current chunk
+ */
+static void push_reset_id(trace_t *trace, int *nids, int id) {
+  if (*nids == trace->reset_cap) {
+    trace->reset_cap = trace->reset_cap ? 2 * trace->reset_cap : OPS_CHUNK;
+    if (!(trace->reset_ids =
+            realloc(trace->reset_ids, trace->reset_cap * sizeof(int))))
+      unix_error("realloc failed in push_reset_id");
+  }
+  trace->reset_ids[(*nids)++] = id;
+}
+
+/*
+ * load_chunk - Decode the next OPS_CHUNK requests of a binary trace starting
+ *     with request i, which must follow the last decoded one, or be 0 to start
+ *     over. Reset lists are built on the fly like in link_regions. Pages of
+ *     the mapping that were decoded already are given back.
+ */
+static void load_chunk(trace_t *trace, int i) {
+  const uint8_t *end = trace->map + trace->maplen;
+  int nids = 0;
+
+  if (trace->map == NULL || (i != 0 && i != trace->pos_op))
+    app_error("%s: requests must be replayed in order", trace->filename);
+
+  if (i == 0) {
+    trace->pos = trace->map + sizeof(tracebin_hdr_t);
+    trace->pos_op = 0;
+    if (trace->num_regions > 0) {
+      memset(trace->region_head, -1, trace->num_regions * sizeof(int));
+      memset(trace->live, 0, trace->num_ids);
+    }
+  }
+
+  size_t done = (trace->pos - trace->map) & -(size_t)getpagesize();
+  if (done > trace->dropped) {
+    madvise((char *)trace->map + trace->dropped, done - trace->dropped,
+            MADV_DONTNEED);
+  }
+  trace->dropped = done;
+
+  int n = trace->num_ops - i < OPS_CHUNK ? trace->num_ops - i : OPS_CHUNK;
+
+  for (int k = 0; k < n; k++) {
+    traceop_t *op = &trace->ops[k];
+    tracebin_op_t bop;
+    int id, bad;
+
+    if (!(trace->pos = tracebin_read_op(trace->pos, end, trace->flags, &bop)))
+      app_error("%s: malformed request %d", trace->filename, i + k);
+
+    op->type = bop.type;
+    op->index = id = bop.id;
+    op->size = bop.size;
+    if (trace->op_threads)
+      trace->op_threads[k] = bop.thread;
+
+    if (bop.type == TR_RESET)
+      bad = id < 0 || id >= trace->num_regions;
+    else
+      bad = id < -1 || id >= trace->num_ids ||
+            (id < 0 && bop.type != TR_FREE) ||
+            (bop.type == TR_RALLOC && bop.region < 0) ||
+            bop.region >= trace->num_regions;
+    if (bad)
+      app_error("%s: request %d out of range", trace->filename, i + k);
+
+    switch (op->type) {
+      case ALLOC:
+        break;
+
+      case RALLOC:
+        trace->block_region[id] = bop.region;
+        trace->live[id] = 1;
+        trace->region_next[id] = trace->region_head[bop.region];
+        trace->region_head[bop.region] = id;
+        break;
+
+      case REALLOC:
+        if (trace->block_region[id] >= 0)
+          app_error("%s: block %d allocated in a region can't be realloc'ed",
+                    trace->filename, id);
+        break;
+
+      case FREE:
+        if (id >= 0 && trace->live)
+          trace->live[id] = 0;
+        break;
+
+      case RESET:
+        op->size = nids;
+        for (int b = trace->region_head[id]; b >= 0;
+             b = trace->region_next[b]) {
+          if (trace->live[b])
+            push_reset_id(trace, &nids, b);
+          trace->live[b] = 0;
+        }
+        push_reset_id(trace, &nids, -1);
+        trace->region_head[id] = -1;
+        break;
+    }
+  }
+
+  trace->chunk_base = i;
+  trace->chunk_len = n;
+  trace->pos_op = i + n;
+}
+
+/*
+ * link_regions - for every RESET find blocks of the region that are still
+ *     live, i.e. were allocated since the previous RESET and not freed.
+ */
+static void link_regions(trace_t *trace) {
+  int *head, *next;
+  int nids = 0;
+
+  if (!(trace->regions = calloc(trace->num_regions, sizeof(mm_region_t *))))
+    unix_error("malloc 1 failed in link_regions");
+  if (!(trace->reset_ids = malloc((trace->num_ops + 1) * sizeof(int))))
+    unix_error("malloc 2 failed in link_regions");
+  if (!(head = malloc(trace->num_regions * sizeof(int))))
+    unix_error("malloc 3 failed in link_regions");
+  if (!(next = malloc(trace->num_ids * sizeof(int))))
+    unix_error("malloc 4 failed in link_regions");
+  memset(head, -1, trace->num_regions * sizeof(int));
+
+  /* reuse block_sizes as the liveness flag, reinit_trace clears it */
+  for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = &trace->ops[i];
+    int region;
+
+    switch (op->type) {
+      case ALLOC:
+        trace->block_sizes[op->index] = 1;
+        break;
+
+      case RALLOC:
+        region = trace->block_region[op->index];
+        trace->block_sizes[op->index] = 1;
+        next[op->index] = head[region];
+        head[region] = op->index;
+        break;
+
+      case REALLOC:
+        if (trace->block_region[op->index] >= 0)
+          app_error("%s: block %d allocated in a region can't be realloc'ed",
+                    trace->filename, op->index);
+        break;
+
+      case FREE:
+        if (op->index >= 0)
+          trace->block_sizes[op->index] = 0;
+        break;
+
+      case RESET:
+        op->size = nids;
+        for (int id = head[op->index]; id >= 0; id = next[id]) {
+          if (trace->block_sizes[id])
+            trace->reset_ids[nids++] = id;
+          trace->block_sizes[id] = 0;
+        }
+        trace->reset_ids[nids++] = -1;
+        head[op->index] = -1;
+        break;
+    }
+  }
+
+  free(head);
+  free(next);
+}
+
+/*
+ * init_regions - create regions for a trace replayed in region mode
+ */
+static void init_regions(trace_t *trace) {
+  if (!region_mode)
+    return;
+  for (int i = 0; i < trace->num_regions; i++)
+    if (!(trace->regions[i] = mm_region_create(REGION_CHUNK)))
+      app_error("mm_region_create failed");
+}
+
+static void load_chunk(trace_t *trace, int i);
+
+/*
+ * trace_op - Return request i. Requests of binary traces must be asked for
+ *     in order, starting from 0 in every pass over the trace.
+ */
+static inline traceop_t *trace_op(trace_t *trace, int i) {
+  if ((unsigned)(i - trace->chunk_base) >= (unsigned)trace->chunk_len)
+    load_chunk(trace, i);
+  return &trace->ops[i - trace->chunk_base];
+}
+
+/*
+ * alloc_op - call mm_malloc, or mm_region_alloc in region mode if the block
+ *     was tagged with a region
+ */
+static inline char *alloc_op(const trace_t *trace, const traceop_t *op) {
+  if (op->type == RALLOC && region_mode)
+    return mm_region_alloc(trace->regions[trace->block_region[op->index]],
+                           op->size);
+  return mm->malloc(op->size);
+}
+
+/*
+ * free_op - call mm_free unless the block lives in a region
+ */
+static inline void free_op(const trace_t *trace, int index, char *p) {
+  if (region_mode && index >= 0 && trace->block_region[index] >= 0)
+    return;
+  mm->free(p);
+}
+
+/*
+ * reset_op - release all blocks of a region
+ */
+static inline void reset_op(const trace_t *trace, const traceop_t *op) {
+  if (region_mode) {
+    mm_region_reset(trace->regions[op->index]);
+    return;
+  }
+  for (int *id = trace->reset_ids + op->size; *id >= 0; id++)
+    mm->free(trace->blocks[*id]);
+}
+
+/*
+ * reinit_trace - get the trace ready for another run.
+ */
+static void reinit_trace(trace_t *trace) {
+  memset(trace->blocks, 0, trace->num_ids * sizeof(*trace->blocks));
+  memset(trace->block_sizes, 0, trace->num_ids * sizeof(*trace->block_sizes));
+  /* block_rand_base is unused if size is zero */
+}
+
+/*
+ * free_trace - Free the trace record and the four arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+static void free_trace(trace_t *trace) {
+  if (trace->map)
+    munmap((void *)trace->map, trace->maplen);
+  free(trace->region_head);
+  free(trace->region_next);
+  free(trace->live);
+  free(trace->op_threads);
+  free(trace->ops); /* free the three arrays... */
+  free(trace->blocks);
+  free(trace->block_sizes);
+  free(trace->block_rand_base);
+  free(trace->block_region);
+  free(trace->reset_ids);
+  free(trace->regions);
+  free(trace); /* and the trace record itself... */
+}
+
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of the libc and mm malloc packages.
+ **********************************************************************/
+
+/*
+ * eval_mm_valid - Check the mm malloc package for correctness
+ */
+static int eval_mm_valid(trace_t *trace, range_t **ranges) {
   /* Reset the heap and free any records in the range list */
   mem_reset_brk();
   clear_ranges(ranges);
   reinit_trace(trace);
 
   /* Call the mm package's init function */
-  if (mm_init() < 0) {
+  if (mm->init() < 0) {
     malloc_error(trace, 0, "mm_init failed.");
     return 0;
   }
+  init_regions(trace);
 
   /* Interpret each operation in the trace in order */
   for (int i = 0; i < trace->num_ops; i++) {
-    int index = trace->ops[i].index;
-    size_t size = trace->ops[i].size;
+    traceop_t *op = trace_op(trace, i);
+    int index = op->index;
+    size_t size = op->size;
     char *newp;
     char *oldp;
     char *p;
 
     if (debug_mode == DBG_EXPENSIVE) {
       /* Let the students check their own heap */
-      mm_checkheap(verbose);
+      mm->checkheap(verbose);
 
       /* Now check that all our allocated blocks have the right data */
-      range_t *r = *ranges;
-      while (r) {
+      for (range_t *r = (*ranges)->next[0]; r != NULL; r = r->next[0])
         check_index(trace, i, r->index);
-        r = r->next;
-      }
     }
 
-    switch (trace->ops[i].type) {
+    switch (op->type) {
       case ALLOC: /* mm_malloc */
+      case RALLOC:
         /* Call the student's malloc */
-        if ((p = mm_malloc(size)) == NULL) {
+        if ((p = alloc_op(trace, op)) == NULL) {
           malloc_error(trace, i, "mm_malloc failed.");
           return 0;
         }
@@ -673,7 +1739,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
 
         /* Call the student's realloc */
         oldp = trace->blocks[index];
-        newp = mm_realloc(oldp, size);
+        newp = mm->realloc(oldp, size);
         if ((newp == NULL) && (size != 0)) {
           malloc_error(trace, i, "mm_realloc failed.");
           return 0;
@@ -712,18 +1778,42 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
           p = trace->blocks[index];
           remove_range(ranges, p);
         }
-        mm_free(p);
+        free_op(trace, index, p);
+        break;
+
+      case RESET: /* mm_region_reset */
+        for (int *id = trace->reset_ids + size; *id >= 0; id++) {
+          check_index(trace, i, *id);
+          remove_range(ranges, trace->blocks[*id]);
+        }
+        reset_op(trace, op);
         break;
 
       default:
         app_error("Nonexistent request type in eval_mm_valid");
     }
+
+    if (series_file && ((i + 1) % series_every == 0 || i + 1 == trace->num_ops))
+      sample_heap(*ranges, i + 1);
   }
 
   /* As far as we know, this is a valid malloc package */
   return 1;
 }
 
+/*
+ * touch_pages - Write a byte to every page of a payload, as the program that
+ *     asked for it would, so that the pages count as resident
+ */
+static void touch_pages(char *p, size_t size) {
+  size_t page = mem_pagesize();
+
+  for (size_t off = 0; off < size; off += page)
+    p[off] = 0;
+  if (size > 0)
+    p[size - 1] = 0;
+}
+
 /*
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for
@@ -735,55 +1825,76 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges) {
  *   is always the high water mark of the heap.
  *
  *   A higher number is better: 1 is optimal.
+ *
+ *   On the way we count how often growing realloc had to move the block and
+ *   how many bytes it had to copy.
  */
-static double eval_mm_util(trace_t *trace, int *used_p, int *total_p) {
+static double eval_mm_util(trace_t *trace, stats_t *stats) {
   int max_total_size = 0;
   int total_size = 0;
 
+  stats->reallocs = 0;
+  stats->moves = 0;
+  stats->copied = 0;
+
   reinit_trace(trace);
 
   /* initialize the heap and the mm malloc package */
   mem_reset_brk();
-  if (mm_init() < 0)
+  mem_rss_reset();
+  if (mm->init() < 0)
     app_error("trace: mm_init failed in eval_mm_util");
+  init_regions(trace);
 
   for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = trace_op(trace, i);
     int index, size, newsize, oldsize;
     char *p, *newp, *oldp;
 
-    switch (trace->ops[i].type) {
+    switch (op->type) {
       case ALLOC: /* mm_alloc */
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
+      case RALLOC:
+        index = op->index;
+        size = op->size;
 
-        if ((p = mm_malloc(size)) == NULL)
+        if ((p = alloc_op(trace, op)) == NULL)
           app_error("trace: mm_malloc failed in eval_mm_util");
 
         /* Remember region and size */
         trace->blocks[index] = p;
         trace->block_sizes[index] = size;
+        touch_pages(p, size);
 
         total_size += size;
         break;
 
       case REALLOC: /* mm_realloc */
-        index = trace->ops[i].index;
-        newsize = trace->ops[i].size;
+        index = op->index;
+        newsize = op->size;
         oldsize = trace->block_sizes[index];
 
         oldp = trace->blocks[index];
-        if ((newp = mm_realloc(oldp, newsize)) == NULL && newsize != 0)
+        if ((newp = mm->realloc(oldp, newsize)) == NULL && newsize != 0)
           app_error("trace: mm_realloc failed in eval_mm_util");
 
+        if (newsize > oldsize) {
+          stats->reallocs++;
+          if (oldp && newp != oldp) {
+            stats->moves++;
+            stats->copied += oldsize;
+          }
+        }
+
         /* Remember region and size */
         trace->blocks[index] = newp;
         trace->block_sizes[index] = newsize;
+        touch_pages(newp, newsize);
 
         total_size += (newsize - oldsize);
         break;
 
       case FREE: /* mm_free */
-        index = trace->ops[i].index;
+        index = op->index;
         if (index < 0) {
           size = 0;
           p = 0;
@@ -792,11 +1903,17 @@ static double eval_mm_util(trace_t *trace, int *used_p, int *total_p) {
           p = trace->blocks[index];
         }
 
-        mm_free(p);
+        free_op(trace, index, p);
 
         total_size -= size;
         break;
 
+      case RESET: /* mm_region_reset */
+        for (int *id = trace->reset_ids + op->size; *id >= 0; id++)
+          total_size -= trace->block_sizes[*id];
+        reset_op(trace, op);
+        break;
+
       default:
         app_error("trace: Nonexistent request type in eval_mm_util");
     }
@@ -804,16 +1921,66 @@ static double eval_mm_util(trace_t *trace, int *used_p, int *total_p) {
     /* update the high-water mark */
     max_total_size =
       (total_size > max_total_size) ? total_size : max_total_size;
+
+    if (i % RSS_EVERY == 0)
+      mem_rss_sample();
   }
 
-  *used_p = max_total_size;
-  *total_p = mem_heapsize();
+  mem_rss_sample();
+  stats->rss_peak = mem_rss_peak();
+  stats->rss_mean = mem_rss_mean();
+  stats->used = max_total_size;
+  stats->total = mem_heapsize();
 
   return ((double)max_total_size / (double)mem_heapsize());
 }
 
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
+ * replay_op - Perform a request of the trace without any checking
+ */
+static inline void replay_op(trace_t *trace, const traceop_t *op) {
+  int index, newsize;
+  char *p, *newp, *oldp, *block;
+
+  switch (op->type) {
+    case ALLOC: /* mm_malloc */
+    case RALLOC:
+      index = op->index;
+      if ((p = alloc_op(trace, op)) == NULL)
+        app_error("mm_malloc error in eval_mm_speed");
+      trace->blocks[index] = p;
+      break;
+
+    case REALLOC: /* mm_realloc */
+      index = op->index;
+      newsize = op->size;
+      oldp = trace->blocks[index];
+      if ((newp = mm->realloc(oldp, newsize)) == NULL && newsize != 0)
+        app_error("mm_realloc error in eval_mm_speed");
+      trace->blocks[index] = newp;
+      break;
+
+    case FREE: /* mm_free */
+      index = op->index;
+      if (index < 0) {
+        block = 0;
+      } else {
+        block = trace->blocks[index];
+      }
+      free_op(trace, index, block);
+      break;
+
+    case RESET: /* mm_region_reset */
+      reset_op(trace, op);
+      break;
+
+    default:
+      app_error("Nonexistent request type in eval_mm_speed");
+  }
+}
+
+/*
+ * eval_mm_speed - This is the function that is used by fsecs()
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr) {
@@ -822,48 +1989,578 @@ static void eval_mm_speed(void *ptr) {
 
   /* Reset the heap and initialize the mm package */
   mem_reset_brk();
-  if (mm_init() < 0)
+  if (mm->init() < 0)
     app_error("mm_init failed in eval_mm_speed");
+  init_regions(trace);
 
   /* Interpret each trace request */
+  for (int i = 0; i < trace->num_ops; i++)
+    replay_op(trace, trace_op(trace, i));
+}
+
+/*
+ * Timer used for single requests. On x86 the time stamp counter is much
+ * cheaper than clock_gettime; its rate is found by timing the whole run.
+ */
+static inline uint64_t ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return now() * 1E9;
+#endif
+}
+
+/*
+ * lat_bucket - Find the histogram bucket of value v
+ */
+static inline int lat_bucket(uint64_t v) {
+  if (v < LAT_SUB)
+    return v;
+  int b = 63 - __builtin_clzll(v);
+  return (b - LAT_SUB_BITS + 1) * LAT_SUB + (v >> (b - LAT_SUB_BITS)) -
+         LAT_SUB;
+}
+
+/*
+ * lat_value - Return the highest value that falls into bucket i
+ */
+static uint64_t lat_value(int i) {
+  int k = i / LAT_SUB, m = i % LAT_SUB;
+  if (k == 0)
+    return m;
+  return ((uint64_t)(LAT_SUB + m + 1) << (k - 1)) - 1;
+}
+
+/*
+ * lat_add - Record a request of opnum that took t ticks
+ */
+static inline void lat_add(latency_t *lat, uint64_t t, int opnum) {
+  lat->count[lat_bucket(t)]++;
+  lat->ops++;
+  if (t >= lat->max) {
+    lat->max = t;
+    lat->worst = opnum;
+  }
+}
+
+/*
+ * lat_percentile - Return the upper bound of the bucket holding fraction p
+ *     of the requests, but no more than the slowest one
+ */
+static uint64_t lat_percentile(const latency_t *lat, double p) {
+  uint64_t rank = ceil(p * lat->ops), seen = 0;
+  int i = 0;
+
+  while (seen + lat->count[i] < rank)
+    seen += lat->count[i++];
+  return lat_value(i) < lat->max ? lat_value(i) : lat->max;
+}
+
+/*
+ * eval_mm_latency - Replay the trace like eval_mm_speed, but time every
+ *     request separately and record it in the histogram of its type.
+ *     Values are kept in ticks and converted to ns when printed.
+ */
+static void eval_mm_latency(trace_t *trace) {
+  memset(latency, 0, sizeof(latency));
+
+  reinit_trace(trace);
+  mem_reset_brk();
+  if (mm->init() < 0)
+    app_error("mm_init failed in eval_mm_latency");
+  init_regions(trace);
+
+  double start_secs = now();
+  uint64_t start_ticks = ticks();
+
   for (int i = 0; i < trace->num_ops; i++) {
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
+    traceop_t *op = trace_op(trace, i);
+    int type = op->type == RALLOC ? ALLOC : op->type;
 
-    switch (trace->ops[i].type) {
-      case ALLOC: /* mm_malloc */
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
-        if ((p = mm_malloc(size)) == NULL)
-          app_error("mm_malloc error in eval_mm_speed");
-        trace->blocks[index] = p;
-        break;
+    uint64_t start = ticks();
+    replay_op(trace, op);
+    lat_add(&latency[type], ticks() - start, i);
+  }
 
-      case REALLOC: /* mm_realloc */
-        index = trace->ops[i].index;
-        newsize = trace->ops[i].size;
-        oldp = trace->blocks[index];
-        if ((newp = mm_realloc(oldp, newsize)) == NULL && newsize != 0)
-          app_error("mm_realloc error in eval_mm_speed");
-        trace->blocks[index] = newp;
-        break;
+  ns_per_tick = 1E9 * (now() - start_secs) / (ticks() - start_ticks);
+}
 
-      case FREE: /* mm_free */
-        index = trace->ops[i].index;
-        if (index < 0) {
-          block = 0;
-        } else {
-          block = trace->blocks[index];
-        }
-        mm_free(block);
-        break;
+/*
+ * save_latency - Keep the percentiles of the latency histograms in stats,
+ *     so that they survive in the stats sent back by suite workers
+ */
+static void save_latency(stats_t *stats) {
+  static const double pct[] = {0.5, 0.99, 0.999};
+
+  for (int type = 0; type <= RESET; type++) {
+    latency_t *lat = &latency[type];
+    if (lat->ops == 0)
+      continue;
+    for (int p = 0; p < 3; p++)
+      stats->lat_ns[type][p] = lat_percentile(lat, pct[p]) * ns_per_tick;
+    stats->lat_ns[type][3] = lat->max * ns_per_tick;
+  }
+}
 
-      default:
-        app_error("Nonexistent request type in eval_mm_speed");
+/*
+ * eval_mm_counters - Replay the trace like eval_mm_latency, reading the
+ *     performance counters before and after every request. The cost of the
+ *     reads themselves is measured first and taken off. Keeps the mean per
+ *     request of each type in stats.
+ */
+#define COUNTER_CALIBRATION 1000
+
+static void eval_mm_counters(trace_t *trace, stats_t *stats) {
+  perfctr_t pc;
+  uint64_t before[PERFCTR_NUM], after[PERFCTR_NUM];
+  double sum[RESET + 1][PERFCTR_NUM], base[PERFCTR_NUM];
+
+  if (perfctr_open(&pc) == 0) {
+    stats->counters_error = pc.error;
+    return;
+  }
+  stats->counters_mask = pc.mask;
+  memset(sum, 0, sizeof(sum));
+  memset(base, 0, sizeof(base));
+  memset(stats->counted, 0, sizeof(stats->counted));
+
+  for (int i = 0; i < COUNTER_CALIBRATION; i++) {
+    perfctr_read(&pc, before);
+    perfctr_read(&pc, after);
+    for (int e = 0; e < PERFCTR_NUM; e++)
+      base[e] += (double)(after[e] - before[e]) / COUNTER_CALIBRATION;
+  }
+
+  reinit_trace(trace);
+  mem_reset_brk();
+  if (mm->init() < 0)
+    app_error("mm_init failed in eval_mm_counters");
+  init_regions(trace);
+
+  for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = trace_op(trace, i);
+    int type = op->type == RALLOC ? ALLOC : op->type;
+
+    perfctr_read(&pc, before);
+    replay_op(trace, op);
+    perfctr_read(&pc, after);
+
+    for (int e = 0; e < PERFCTR_NUM; e++)
+      sum[type][e] += after[e] - before[e];
+    stats->counted[type]++;
+  }
+
+  /* counts are missing for the time the kernel multiplexed the group */
+  stats->counters_running = perfctr_read(&pc, after);
+  perfctr_close(&pc);
+  if (stats->counters_running == 0) {
+    /* the group was never scheduled, so the counts are not zeros */
+    stats->counters_mask = 0;
+    stats->counters_error = EBUSY;
+    return;
+  }
+
+  for (int type = 0; type <= RESET; type++) {
+    if (stats->counted[type] == 0)
+      continue;
+    for (int e = 0; e < PERFCTR_NUM; e++) {
+      double v = (sum[type][e] / stats->counted[type] - base[e]) /
+                 stats->counters_running;
+      stats->counters[type][e] = v > 0 ? v : 0;
     }
   }
 }
 
+/*
+ * Payloads are touched once per cache line. The live blocks are kept in a
+ * list in the order they were allocated, which is the order in which a
+ * program would usually link and walk them.
+ */
+#define TOUCH_LINE 64
+
+typedef struct {
+  int *next, *prev; /* prev is -2 for blocks that are not live */
+  int head, tail;
+} livelist_t;
+
+static volatile unsigned long touch_sink; /* keeps the reads */
+
+static void live_add(livelist_t *l, int id) {
+  l->prev[id] = l->tail;
+  l->next[id] = -1;
+  if (l->tail >= 0)
+    l->next[l->tail] = id;
+  else
+    l->head = id;
+  l->tail = id;
+}
+
+static void live_remove(livelist_t *l, int id) {
+  if (id < 0 || l->prev[id] == -2)
+    return;
+  if (l->prev[id] >= 0)
+    l->next[l->prev[id]] = l->next[id];
+  else
+    l->head = l->next[id];
+  if (l->next[id] >= 0)
+    l->prev[l->next[id]] = l->prev[id];
+  else
+    l->tail = l->prev[id];
+  l->prev[id] = -2;
+}
+
+/*
+ * touch_payload - Do what a program does with the block of the request just
+ *     made: fill a new block, update a reallocated one and fill its new
+ *     part. Return the number of bytes touched.
+ */
+static size_t touch_payload(trace_t *trace, const traceop_t *op) {
+  size_t off, old, size = op->size;
+  char *p;
+
+  switch (op->type) {
+    case ALLOC:
+    case RALLOC:
+      p = trace->blocks[op->index];
+      for (off = 0; off < size; off += TOUCH_LINE)
+        p[off] = (char)off;
+      return size;
+
+    case REALLOC:
+      p = trace->blocks[op->index];
+      old = trace->block_sizes[op->index];
+      for (off = 0; off < size && off < old; off += TOUCH_LINE)
+        p[off]++;
+      for (; off < size; off += TOUCH_LINE)
+        p[off] = (char)off;
+      return size;
+
+    default:
+      return 0;
+  }
+}
+
+/*
+ * touch_live - Read every live block, in the order they were allocated.
+ *     Return the number of bytes touched.
+ */
+static size_t touch_live(const trace_t *trace, const livelist_t *l) {
+  unsigned long sum = 0;
+  size_t bytes = 0;
+
+  for (int id = l->head; id >= 0; id = l->next[id]) {
+    const char *p = trace->blocks[id];
+    size_t size = trace->block_sizes[id];
+    for (size_t off = 0; off < size; off += TOUCH_LINE)
+      sum += p[off];
+    bytes += size;
+  }
+  touch_sink = sum;
+  return bytes;
+}
+
+/*
+ * touch_update - Keep the list of live blocks and their sizes up to date
+ */
+static void touch_update(trace_t *trace, const traceop_t *op, livelist_t *l) {
+  switch (op->type) {
+    case ALLOC:
+    case RALLOC:
+      trace->block_sizes[op->index] = op->size;
+      live_add(l, op->index);
+      break;
+    case REALLOC:
+      trace->block_sizes[op->index] = op->size;
+      if (op->size == 0)
+        live_remove(l, op->index);
+      else if (l->prev[op->index] == -2)
+        live_add(l, op->index);
+      break;
+    case FREE:
+      live_remove(l, op->index);
+      break;
+    case RESET:
+      for (int *id = trace->reset_ids + op->size; *id >= 0; id++)
+        live_remove(l, *id);
+      break;
+  }
+}
+
+/*
+ * touch_replay - Replay the trace, touching the payloads after every
+ *     request and walking the live blocks every touch_every requests. Adds
+ *     the ticks spent in the allocator and on the payloads to mm_ticks and
+ *     touch_ticks. With pc, adds the events counted while touching to sum
+ *     instead. Returns the bytes touched.
+ */
+static double touch_replay(trace_t *trace, perfctr_t *pc, double *sum,
+                           uint64_t *mm_ticks, uint64_t *touch_ticks) {
+  uint64_t before[PERFCTR_NUM], after[PERFCTR_NUM];
+  livelist_t live = {.head = -1, .tail = -1};
+  double bytes = 0;
+
+  if (!(live.next = malloc(trace->num_ids * sizeof(int))) ||
+      !(live.prev = malloc(trace->num_ids * sizeof(int))))
+    unix_error("malloc failed in touch_replay");
+  for (int i = 0; i < trace->num_ids; i++)
+    live.prev[i] = -2;
+
+  reinit_trace(trace);
+  mem_reset_brk();
+  if (mm->init() < 0)
+    app_error("mm_init failed in eval_mm_touch");
+  init_regions(trace);
+
+  for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = trace_op(trace, i);
+
+    uint64_t start = ticks();
+    replay_op(trace, op);
+    uint64_t mid = ticks();
+    if (pc)
+      perfctr_read(pc, before);
+
+    bytes += touch_payload(trace, op);
+    if ((i + 1) % touch_every == 0)
+      bytes += touch_live(trace, &live);
+
+    if (pc) {
+      perfctr_read(pc, after);
+      for (int e = 0; e < PERFCTR_NUM; e++)
+        sum[e] += after[e] - before[e];
+    }
+    uint64_t end = ticks();
+    *mm_ticks += mid - start;
+    *touch_ticks += end - mid;
+
+    touch_update(trace, op, &live);
+  }
+
+  free(live.next);
+  free(live.prev);
+  return bytes;
+}
+
+/*
+ * eval_mm_touch - Measure what the placement of blocks costs the program
+ *     that uses them. One replay times the allocator and the touching of
+ *     the payloads, another one counts events while touching, so that
+ *     reading the counters doesn't add to the times.
+ */
+static void eval_mm_touch(trace_t *trace, stats_t *stats) {
+  uint64_t mm_ticks = 0, touch_ticks = 0;
+  double sum[PERFCTR_NUM], base[PERFCTR_NUM];
+  uint64_t before[PERFCTR_NUM], after[PERFCTR_NUM];
+  perfctr_t pc;
+
+  double start_secs = now();
+  uint64_t start_ticks = ticks();
+  double bytes = touch_replay(trace, NULL, NULL, &mm_ticks, &touch_ticks);
+  double tick_ns = 1E9 * (now() - start_secs) / (ticks() - start_ticks);
+
+  stats->touch_ns = touch_ticks * tick_ns / trace->num_ops;
+  stats->touch_mm_ns = mm_ticks * tick_ns / trace->num_ops;
+  stats->touch_bytes = bytes / trace->num_ops;
+  stats->touch_walks = trace->num_ops / touch_every;
+
+  if (perfctr_open(&pc) == 0)
+    return;
+  stats->touch_mask = pc.mask;
+  memset(sum, 0, sizeof(sum));
+  memset(base, 0, sizeof(base));
+
+  for (int i = 0; i < COUNTER_CALIBRATION; i++) {
+    perfctr_read(&pc, before);
+    perfctr_read(&pc, after);
+    for (int e = 0; e < PERFCTR_NUM; e++)
+      base[e] += (double)(after[e] - before[e]) / COUNTER_CALIBRATION;
+  }
+
+  touch_replay(trace, &pc, sum, &mm_ticks, &touch_ticks);
+  double running = perfctr_read(&pc, after);
+  perfctr_close(&pc);
+  if (running == 0) {
+    stats->touch_mask = 0;
+    return;
+  }
+
+  for (int e = 0; e < PERFCTR_NUM; e++) {
+    double v = (sum[e] / trace->num_ops - base[e]) / running;
+    stats->touch_counters[e] = v > 0 ? v : 0;
+  }
+}
+
+/*
+ * mt_replay_op - Perform a request in a replay thread. Regions are not
+ *     supported, so RALLOC is a plain allocation. Allocators of the
+ *     simulated heap are called under mm_lock.
+ */
+static void mt_replay_op(trace_t *trace, const traceop_t *op) {
+  char **block = op->index >= 0 ? &trace->blocks[op->index] : NULL;
+
+  if (mm->sim_heap)
+    pthread_mutex_lock(&mm_lock);
+  switch (op->type) {
+    case ALLOC:
+    case RALLOC:
+      if ((*block = mm->malloc(op->size)) == NULL)
+        app_error("%s_malloc error in eval_threads", mm->name);
+      break;
+    case REALLOC:
+      if ((*block = mm->realloc(*block, op->size)) == NULL && op->size != 0)
+        app_error("%s_realloc error in eval_threads", mm->name);
+      break;
+    default:
+      mm->free(block ? *block : NULL);
+      break;
+  }
+  if (mm->sim_heap)
+    pthread_mutex_unlock(&mm_lock);
+}
+
+/*
+ * wait_turn - Wait until the requests before seq on a block are done.
+ *     Spin briefly, then yield, since the thread we wait for may need
+ *     our CPU.
+ */
+static inline void wait_turn(const int *done, int seq) {
+  for (int spins = 0; __atomic_load_n(done, __ATOMIC_ACQUIRE) != seq;
+       spins++) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+    if (spins >= 64)
+      sched_yield();
+  }
+}
+
+static void *mt_worker(void *arg) {
+  worker_t *w = arg;
+
+  memset(&w->lat, 0, sizeof(w->lat));
+  for (int i = 0; i < w->num_ops; i++) {
+    const mtop_t *m = &w->ops[i];
+    int index = m->op.index;
+
+    if (index >= 0)
+      wait_turn(&w->done[index], m->seq);
+
+    uint64_t start = ticks();
+    mt_replay_op(w->trace, &m->op);
+    lat_add(&w->lat, ticks() - start, m->opnum);
+
+    if (index >= 0)
+      __atomic_store_n(&w->done[index], m->seq + 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/*
+ * eval_threads_speed - Replay the requests split by split_threads on
+ *     their threads. Used by fsecs, like eval_mm_speed.
+ */
+static void eval_threads_speed(void *ptr) {
+  threads_t *mt = ptr;
+  trace_t *trace = mt->trace;
+
+  reinit_trace(trace);
+  memset(mt->done, 0, trace->num_ids * sizeof(int));
+  mem_reset_brk();
+  if (mm->init() < 0)
+    app_error("%s_init failed in eval_threads", mm->name);
+
+  for (int i = 0; i < mt->num_workers; i++)
+    if ((errno = pthread_create(&mt->workers[i].tid, NULL, mt_worker,
+                                &mt->workers[i])))
+      unix_error("pthread_create failed in eval_threads");
+  for (int i = 0; i < mt->num_workers; i++)
+    pthread_join(mt->workers[i].tid, NULL);
+}
+
+/*
+ * split_threads - Hand the requests of recorded thread t to worker
+ *     t % num_workers, numbering the requests on each block on the way.
+ *     Returns the number of recorded threads.
+ */
+static int split_threads(threads_t *mt) {
+  trace_t *trace = mt->trace;
+  int *seq, nthreads = 1;
+
+  if (!(seq = calloc(trace->num_ids, sizeof(int))))
+    unix_error("calloc failed in split_threads");
+
+  for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = trace_op(trace, i);
+    int t = trace->op_threads ? trace->op_threads[i - trace->chunk_base] : 0;
+
+    if (op->type == RESET)
+      app_error("%s: traces with regions can't be replayed on threads\n",
+                trace->filename);
+    if (t >= nthreads)
+      nthreads = t + 1;
+
+    worker_t *w = &mt->workers[t % mt->num_workers];
+    if (w->num_ops == w->max_ops) {
+      w->max_ops = w->max_ops ? 2 * w->max_ops : OPS_CHUNK;
+      if (!(w->ops = realloc(w->ops, w->max_ops * sizeof(mtop_t))))
+        unix_error("realloc failed in split_threads");
+    }
+    mtop_t *m = &w->ops[w->num_ops++];
+    m->op = *op;
+    m->opnum = i;
+    m->seq = op->index >= 0 ? seq[op->index]++ : 0;
+  }
+
+  free(seq);
+  return nthreads;
+}
+
+/*
+ * eval_threads - Replay the trace on 1 to max_threads threads, with the
+ *     requests of each recorded thread on one of them. A request waits for
+ *     the earlier requests on its block, wherever they run, so a block is
+ *     never freed before it is allocated. The earliest request not done
+ *     never waits, so the replay can't deadlock. Calls to allocators of the
+ *     simulated heap are serialized by mm_lock, calls to the libc are not.
+ */
+static void eval_threads(trace_t *trace) {
+  threads_t mt = {.trace = trace};
+  stats_t stats;
+
+  if (!(thread_runs = calloc(max_threads, sizeof(threadrun_t))) ||
+      !(mt.done = malloc(trace->num_ids * sizeof(int))))
+    unix_error("malloc failed in eval_threads");
+
+  for (int n = 1; n <= max_threads; n++) {
+    threadrun_t *run = &thread_runs[n - 1];
+
+    if (!(mt.workers = calloc(n, sizeof(worker_t))))
+      unix_error("calloc failed in eval_threads");
+    mt.num_workers = n;
+    for (int i = 0; i < n; i++) {
+      mt.workers[i].trace = trace;
+      mt.workers[i].done = mt.done;
+    }
+    recorded_threads = split_threads(&mt);
+
+    double start_secs = now();
+    uint64_t start_ticks = ticks();
+    run->secs = fsecs(eval_threads_speed, &mt, &stats);
+    run->ns_per_tick = 1E9 * (now() - start_secs) / (ticks() - start_ticks);
+
+    /* keep the histograms of the last run */
+    if (!(run->lat = malloc(n * sizeof(latency_t))))
+      unix_error("malloc failed in eval_threads");
+    for (int i = 0; i < n; i++) {
+      run->lat[i] = mt.workers[i].lat;
+      free(mt.workers[i].ops);
+    }
+    free(mt.workers);
+  }
+
+  free(mt.done);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -874,36 +2571,43 @@ static int eval_libc_valid(trace_t *trace) {
   reinit_trace(trace);
 
   for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = trace_op(trace, i);
     char *p, *newp, *oldp;
     int newsize;
 
-    switch (trace->ops[i].type) {
+    switch (op->type) {
       case ALLOC: /* malloc */
-        if ((p = malloc(trace->ops[i].size)) == NULL) {
+      case RALLOC:
+        if ((p = malloc(op->size)) == NULL) {
           malloc_error(trace, i, "libc malloc failed");
           unix_error("System message");
         }
-        trace->blocks[trace->ops[i].index] = p;
+        trace->blocks[op->index] = p;
         break;
 
       case REALLOC: /* realloc */
-        newsize = trace->ops[i].size;
-        oldp = trace->blocks[trace->ops[i].index];
+        newsize = op->size;
+        oldp = trace->blocks[op->index];
         if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0) {
           malloc_error(trace, i, "libc realloc failed");
           unix_error("System message");
         }
-        trace->blocks[trace->ops[i].index] = newp;
+        trace->blocks[op->index] = newp;
         break;
 
       case FREE: /* free */
-        if (trace->ops[i].index >= 0) {
-          free(trace->blocks[trace->ops[i].index]);
+        if (op->index >= 0) {
+          free(trace->blocks[op->index]);
         } else {
           free(0);
         }
         break;
 
+      case RESET: /* free all blocks of the region */
+        for (int *id = trace->reset_ids + op->size; *id >= 0; id++)
+          free(trace->blocks[*id]);
+        break;
+
       default:
         app_error("invalid operation type  in eval_libc_valid");
     }
@@ -913,7 +2617,7 @@ static int eval_libc_valid(trace_t *trace) {
 }
 
 /*
- * eval_libc_speed - This is the function that is used by fcyc() to
+ * eval_libc_speed - This is the function that is used by fsecs() to
  *    measure the running time of the libc malloc package on the set
  *    of traces.
  */
@@ -923,21 +2627,23 @@ static void eval_libc_speed(void *ptr) {
   reinit_trace(trace);
 
   for (int i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = trace_op(trace, i);
     char *p, *newp, *oldp, *block;
     int index, size, newsize;
 
-    switch (trace->ops[i].type) {
+    switch (op->type) {
       case ALLOC: /* malloc */
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
+      case RALLOC:
+        index = op->index;
+        size = op->size;
         if ((p = malloc(size)) == NULL)
           unix_error("malloc failed in eval_libc_speed");
         trace->blocks[index] = p;
         break;
 
       case REALLOC: /* realloc */
-        index = trace->ops[i].index;
-        newsize = trace->ops[i].size;
+        index = op->index;
+        newsize = op->size;
         oldp = trace->blocks[index];
         if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0)
           unix_error("realloc failed in eval_libc_speed\n");
@@ -946,7 +2652,7 @@ static void eval_libc_speed(void *ptr) {
         break;
 
       case FREE: /* free */
-        index = trace->ops[i].index;
+        index = op->index;
         if (index >= 0) {
           block = trace->blocks[index];
           free(block);
@@ -954,6 +2660,11 @@ static void eval_libc_speed(void *ptr) {
           free(0);
         }
         break;
+
+      case RESET: /* free all blocks of the region */
+        for (int *id = trace->reset_ids + op->size; *id >= 0; id++)
+          free(trace->blocks[*id]);
+        break;
     }
   }
 }
@@ -969,6 +2680,13 @@ static void printresults(stats_t *stats) {
   /* Print the individual results for each trace */
   printf("  %2s%6s%8s%8s %5s%8s%10s  %s\n", "valid", "util", "used", "total",
          "ops", "secs", "Kops", "trace");
+  printrow(stats);
+}
+
+/*
+ * printrow - Print the results of one trace
+ */
+static void printrow(stats_t *stats) {
   if (!stats->valid) {
     printf("%2s%4s %6s%8s%10s%7s %s\n", stats->weight != 0 ? "*" : "", "no",
            "-", "-", "-", "-", stats->filename);
@@ -1014,6 +2732,458 @@ static void printresults(stats_t *stats) {
   printf(" %s\n", stats->filename);
 }
 
+/*
+ * Machine-readable records: one JSON object per line, or CSV with a header
+ * row. Fields are only ever added, so parsers that look them up by name
+ * keep working. Measurements of invalid traces are null (empty in CSV).
+ */
+static int record_fields; /* fields printed in the current record */
+static int record_names;  /* print the CSV header instead of values */
+
+static void field(const char *name, int known, const char *fmt, ...) {
+  va_list ap;
+
+  if (output == OUT_JSON)
+    printf("%s\"%s\": ", record_fields ? ", " : "{", name);
+  else if (record_fields)
+    putchar(',');
+  record_fields++;
+
+  if (record_names) {
+    printf("%s", name);
+  } else if (!known) {
+    printf("%s", output == OUT_JSON ? "null" : "");
+  } else {
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+  }
+}
+
+/* A string field, quoted as JSON or CSV wants it */
+static void field_str(const char *name, const char *str) {
+  field(name, 1, "%s", "");
+  if (record_names)
+    return;
+  putchar('"');
+  for (const char *c = str; *c; c++) {
+    if (*c == '"')
+      putchar(output == OUT_JSON ? '\\' : '"');
+    else if (*c == '\\' && output == OUT_JSON)
+      putchar('\\');
+    putchar(*c);
+  }
+  putchar('"');
+}
+
+static void record_body(stats_t *stats) {
+  static const char *type_name[] = {"malloc", "free", "realloc", "", "reset"};
+  static const char *pct_name[] = {"p50", "p99", "p999", "max"};
+  int v = stats->valid;
+  const allocator_t *a = &allocators[stats->allocator];
+  int m = v && a->sim_heap; /* measured for the simulated heap only */
+
+  field_str("trace", stats->filename);
+  field_str("allocator", a->name);
+  field("format", 1, "\"%s\"", stats->binary ? "binary" : "text");
+  field("weight", 1, "%d", stats->weight);
+  field("ops", 1, "%.0f", stats->ops);
+  field("blocks", 1, "%d", stats->num_ids);
+  field("regions", 1, "%d", stats->num_regions);
+  field("valid", 1, "%s", v ? "true" : "false");
+  field("secs", v, "%.9f", stats->secs);
+  field("secs_median", v, "%.9f", stats->secs_median);
+  field("secs_lo", v, "%.9f", stats->secs_lo);
+  field("secs_hi", v, "%.9f", stats->secs_hi);
+  field("runs", 1, "%d", timing_reps);
+  field("warmup", 1, "%d", timing_warmup);
+  field("kops", v, "%.3f", v ? stats->ops / 1e3 / stats->secs : 0.0);
+  field("util", m, "%.6f", stats->util);
+  field("used", m, "%d", stats->used);
+  field("total", m, "%d", stats->total);
+  field("faults", m, "%ld", stats->faults);
+  field("rss_peak", m, "%ld", stats->rss_peak);
+  field("rss_mean", m, "%.0f", stats->rss_mean);
+  field("rss_util", m && stats->rss_peak, "%.6f",
+        m && stats->rss_peak ? (double)stats->used / stats->rss_peak : 0.0);
+  field("reallocs", m, "%d", stats->reallocs);
+  field("moves", m, "%d", stats->moves);
+  field("copied", m, "%ld", stats->copied);
+  field("backend", 1, "\"%s\"", mem_backend_name());
+  field("page_kb", 1, "%zu", mem_backing_pagesize() >> 10);
+
+  for (int type = 0; type <= RESET && counter_mode; type++) {
+    if (type == RALLOC)
+      continue;
+    for (int e = 0; e < PERFCTR_NUM; e++) {
+      char name[32];
+      int len = snprintf(name, sizeof(name), "%s_", type_name[type]);
+      /* "L1d-misses" becomes "l1d_misses" */
+      for (const char *c = perfctr_names[e]; *c; c++)
+        name[len++] = *c == '-' ? '_' : tolower(*c);
+      name[len] = '\0';
+      field(name, m && stats->counted[type] && (stats->counters_mask >> e) & 1,
+            "%.2f", stats->counters[type][e]);
+    }
+  }
+
+  if (touch_every) {
+    field("touch_ns", m, "%.2f", stats->touch_ns);
+    field("touch_mm_ns", m, "%.2f", stats->touch_mm_ns);
+    field("touch_bytes", m, "%.1f", stats->touch_bytes);
+    for (int e = 0; e < PERFCTR_NUM; e++) {
+      char name[32];
+      int len = snprintf(name, sizeof(name), "touch_");
+      for (const char *c = perfctr_names[e]; *c; c++)
+        name[len++] = *c == '-' ? '_' : tolower(*c);
+      name[len] = '\0';
+      field(name, m && (stats->touch_mask >> e) & 1, "%.2f",
+            stats->touch_counters[e]);
+    }
+  }
+
+  if (!latency_mode)
+    return;
+  for (int type = 0; type <= RESET; type++) {
+    if (type == RALLOC)
+      continue;
+    int seen = m && stats->lat_ns[type][3] > 0;
+    for (int p = 0; p < 4; p++) {
+      char name[32];
+      snprintf(name, sizeof(name), "%s_%s_ns", type_name[type], pct_name[p]);
+      field(name, seen, "%.0f", stats->lat_ns[type][p]);
+    }
+  }
+}
+
+/*
+ * printrecord - Print the results of one trace as a record; the first
+ *     CSV record is preceded by the header
+ */
+static void printrecord(stats_t *stats, int first) {
+  if (output == OUT_CSV && first) {
+    record_fields = 0;
+    record_names = 1;
+    record_body(stats);
+    record_names = 0;
+    putchar('\n');
+  }
+
+  record_fields = 0;
+  record_body(stats);
+  printf(output == OUT_JSON ? "}\n" : "\n");
+}
+
+/*
+ * printcmprow - Print one allocator's row of the comparison. util is
+ *     negative if it was not measured; base is NULL for the first allocator,
+ *     which gets no deltas.
+ */
+static void printcmprow(const char *name, int valid, double util, double kops,
+                        const stats_t *base, double base_util,
+                        double base_kops, const char *label) {
+  printf("  %-10s %4s", name, valid ? "yes" : "no");
+  if (!valid) {
+    printf(" %6s %9s %9s %8s  %s\n", "-", "-", "-", "-", label);
+    return;
+  }
+
+  if (util < 0)
+    printf(" %6s %9s", "-", "-");
+  else if (base == NULL || base_util < 0)
+    printf(" %5.1f%% %9s", 100 * util, "-");
+  else
+    printf(" %5.1f%% %+6.1f pp", 100 * util, 100 * (util - base_util));
+
+  if (base == NULL)
+    printf(" %9.0f %8s", kops, "-");
+  else
+    printf(" %9.0f %+7.1f%%", kops, 100 * (kops / base_kops - 1));
+  printf("  %s\n", label);
+}
+
+/*
+ * printcompare - Print the results of all selected allocators side by side,
+ *     with the difference to the first one: percentage points of
+ *     utilization and percent of throughput. stats holds num_selected
+ *     entries per trace. Several traces get totals as in run_suite.
+ */
+static void printcompare(stats_t *stats, int num) {
+  const allocator_t *first = &allocators[selected[0]];
+  int n = num_selected;
+  double *util, *ops, *secs, all_ops = 0;
+  int *valid;
+
+  if (!(util = calloc(n, sizeof(double))) ||
+      !(ops = calloc(n, sizeof(double))) ||
+      !(secs = calloc(n, sizeof(double))) || !(valid = calloc(n, sizeof(int))))
+    unix_error("calloc failed in printcompare");
+
+  printf("\nComparison with %s malloc:\n", first->name);
+  printf("  %-10s %4s %6s %9s %9s %8s  %s\n", "allocator", "valid", "util",
+         "delta", "Kops", "delta", "trace");
+
+  for (int i = 0; i < num; i++) {
+    stats_t *st = &stats[i * n];
+    all_ops += st->ops;
+    for (int k = 0; k < n; k++) {
+      const allocator_t *a = &allocators[selected[k]];
+      printcmprow(a->name, st[k].valid, a->sim_heap ? st[k].util : -1,
+                  st[k].ops / 1e3 / st[k].secs,
+                  k > 0 && st[0].valid ? &st[0] : NULL,
+                  first->sim_heap ? st[0].util : -1,
+                  st[0].ops / 1e3 / st[0].secs, k == 0 ? st->filename : "");
+
+      if (!st[k].valid)
+        continue;
+      valid[k]++;
+      util[k] += st[k].util * st[k].ops;
+      ops[k] += st[k].ops;
+      secs[k] += st[k].secs;
+    }
+  }
+
+  /* weighted utilization and throughput over the suite */
+  for (int k = 0; num > 1 && k < n; k++) {
+    const allocator_t *a = &allocators[selected[k]];
+    char label[64];
+
+    snprintf(label, sizeof(label), "total, %d of %d valid", valid[k], num);
+    printcmprow(a->name, 1, a->sim_heap ? util[k] / all_ops : -1,
+                ops[k] / 1e3 / secs[k], k > 0 ? stats : NULL,
+                first->sim_heap ? util[0] / all_ops : -1,
+                ops[0] / 1e3 / secs[0], label);
+  }
+
+  free(util);
+  free(ops);
+  free(secs);
+  free(valid);
+}
+
+/* baseline of one allocator on one trace, see check_baseline */
+typedef struct {
+  char allocator[64];
+  char filename[MAXLINE];
+  double util;  /* -1 if not measured */
+  double instr; /* instructions per request, -1 if not counted */
+  int nsamples;
+  double samples[MAX_SAMPLES];
+} baseline_t;
+
+/* mean instructions per request of any type, -1 if they were not counted */
+static double instr_per_op(const stats_t *stats) {
+  double instr = 0;
+  long ops = 0;
+
+  if (!(stats->counters_mask & (1u << PERFCTR_INSTRUCTIONS)))
+    return -1;
+  for (int type = 0; type <= RESET; type++) {
+    instr += stats->counters[type][PERFCTR_INSTRUCTIONS] * stats->counted[type];
+    ops += stats->counted[type];
+  }
+  return ops ? instr / ops : -1;
+}
+
+static int read_baseline(const char *name, baseline_t **base) {
+  char line[MAX_SAMPLES * 24 + 2 * MAXLINE];
+  char util[32], instr[32];
+  int num = 0, max = 0;
+  FILE *f;
+
+  if (!(f = fopen(name, "r")))
+    unix_error("Could not open baseline %s", name);
+
+  *base = NULL;
+  while (fgets(line, sizeof(line), f)) {
+    baseline_t *b;
+    char *p = line;
+    int len;
+
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (num == max) {
+      max = max ? 2 * max : 64;
+      if (!(*base = realloc(*base, max * sizeof(baseline_t))))
+        unix_error("realloc failed in read_baseline");
+    }
+    b = &(*base)[num++];
+    if (sscanf(p, "%63s %1023s %31s %31s %d%n", b->allocator, b->filename,
+               util, instr, &b->nsamples, &len) != 5 ||
+        b->nsamples < 0 || b->nsamples > MAX_SAMPLES)
+      app_error("Bogus line %d in baseline %s\n", num, name);
+    b->util = strcmp(util, "-") ? atof(util) : -1;
+    b->instr = strcmp(instr, "-") ? atof(instr) : -1;
+    for (int i = 0; i < b->nsamples; i++) {
+      p += len;
+      if (sscanf(p, "%lf%n", &b->samples[i], &len) != 1)
+        app_error("Bogus line %d in baseline %s\n", num, name);
+    }
+  }
+  fclose(f);
+  return num;
+}
+
+static void write_baseline(const char *name, stats_t *stats, int num) {
+  FILE *f;
+
+  if (!(f = fopen(name, "w")))
+    unix_error("Could not create baseline %s", name);
+
+  fprintf(f, "# allocator trace util instructions/op runs secs...\n");
+  for (int i = 0; i < num; i++) {
+    const stats_t *st = &stats[i];
+    const allocator_t *a = &allocators[st->allocator];
+    double instr = instr_per_op(st);
+
+    if (!st->valid)
+      continue;
+    fprintf(f, "%s %s ", a->name, st->filename);
+    if (a->sim_heap)
+      fprintf(f, "%.6f ", st->util);
+    else
+      fprintf(f, "- ");
+    if (instr >= 0)
+      fprintf(f, "%.2f ", instr);
+    else
+      fprintf(f, "- ");
+    fprintf(f, "%d", st->nsamples);
+    for (int k = 0; k < st->nsamples; k++)
+      fprintf(f, " %.9g", st->samples[k]);
+    fputc('\n', f);
+  }
+  if (fclose(f))
+    unix_error("Could not write baseline %s", name);
+}
+
+/*
+ * mann_whitney - Two-sided p-value of the Mann-Whitney U test of samples
+ *     x and y, in the normal approximation with correction for ties and
+ *     continuity. Both samples must be sorted.
+ */
+static double mann_whitney(const double *x, int nx, const double *y, int ny) {
+  double n = nx + ny, rank_x = 0, ties = 0;
+  int i = 0, j = 0;
+
+  if (nx < 2 || ny < 2)
+    return 1;
+
+  /* merge the samples, giving each run of equal values its mean rank */
+  while (i < nx || j < ny) {
+    double v = j == ny || (i < nx && x[i] <= y[j]) ? x[i] : y[j];
+    int from = i + j, in_x = 0;
+
+    while (i < nx && x[i] == v)
+      i++, in_x++;
+    while (j < ny && y[j] == v)
+      j++;
+
+    double t = i + j - from;
+    rank_x += in_x * (from + (1 + t) / 2);
+    ties += t * t * t - t;
+  }
+
+  double u = rank_x - nx * (nx + 1.0) / 2;
+  double mean = nx * (double)ny / 2;
+  double var = nx * (double)ny / 12 * (n + 1 - ties / (n * (n - 1)));
+  if (var <= 0)
+    return 1;
+
+  double z = (fabs(u - mean) - 0.5) / sqrt(var);
+  return z > 0 ? erfc(z / sqrt(2)) : 1;
+}
+
+static double sample_median(const double *t, int n) {
+  return n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+}
+
+/*
+ * check_baseline - Write the results to the baseline file given with -B,
+ *     and report the traces that moved against the one given with -C.
+ *     Utilization and instruction counts hardly vary between runs and are
+ *     compared against thresholds, times with a Mann-Whitney U test.
+ *     Return the number of regressions.
+ */
+static int check_baseline(stats_t *stats, int num) {
+  FILE *out = output == OUT_TABLE ? stdout : stderr;
+  int compared = 0, regressions = 0, improvements = 0;
+  baseline_t *base;
+  int nbase;
+
+  if (baseline_out)
+    write_baseline(baseline_out, stats, num);
+  if (!baseline_in)
+    return 0;
+
+  nbase = read_baseline(baseline_in, &base);
+  fprintf(out, "\nComparison with baseline %s (p < %g, %d runs):\n",
+          baseline_in, SIGNIFICANCE, timing_reps);
+
+  for (int i = 0; i < num; i++) {
+    const stats_t *st = &stats[i];
+    const char *name = allocators[st->allocator].name;
+    const baseline_t *b = NULL;
+
+    for (int k = 0; k < nbase && !b; k++)
+      if (!strcmp(base[k].allocator, name) &&
+          !strcmp(base[k].filename, st->filename))
+        b = &base[k];
+    if (!b) {
+      fprintf(out, "  %-8s %s (%s): not in the baseline\n", "new",
+              st->filename, name);
+      continue;
+    }
+    if (!st->valid) {
+      fprintf(out, "  %-8s %s (%s): not valid\n", "invalid", st->filename,
+              name);
+      regressions++;
+      continue;
+    }
+    compared++;
+
+    if (b->util >= 0 && allocators[st->allocator].sim_heap &&
+        fabs(st->util - b->util) >= MIN_UTIL) {
+      int worse = st->util < b->util;
+      fprintf(out, "  %-8s %s (%s): util %.1f%% -> %.1f%%\n",
+              worse ? "util" : "util+", st->filename, name, 100 * b->util,
+              100 * st->util);
+      worse ? regressions++ : improvements++;
+    }
+
+    double instr = instr_per_op(st);
+    if (b->instr > 0 && instr >= 0 &&
+        fabs(instr / b->instr - 1) >= MIN_INSTR) {
+      int worse = instr > b->instr;
+      fprintf(out,
+              "  %-8s %s (%s): %.1f -> %.1f instructions per request "
+              "(%+.1f%%)\n",
+              worse ? "instr" : "instr-", st->filename, name, b->instr, instr,
+              100 * (instr / b->instr - 1));
+      worse ? regressions++ : improvements++;
+    }
+
+    if (b->nsamples == 0 || st->nsamples == 0)
+      continue;
+    double p = mann_whitney(b->samples, b->nsamples, st->samples, st->nsamples);
+    double before = sample_median(b->samples, b->nsamples);
+    double after = sample_median(st->samples, st->nsamples);
+    if (p < SIGNIFICANCE && fabs(after / before - 1) >= MIN_EFFECT) {
+      int worse = after > before;
+      fprintf(out,
+              "  %-8s %s (%s): median %.6f -> %.6f secs (%+.1f%%), "
+              "p = %.2g\n",
+              worse ? "slower" : "faster", st->filename, name, before, after,
+              100 * (after / before - 1), p);
+      worse ? regressions++ : improvements++;
+    }
+  }
+
+  fprintf(out, "%d of %d results compared: %d regressions, %d improvements\n",
+          compared, num, regressions, improvements);
+  free(base);
+  return regressions;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1037,6 +3207,17 @@ static void unix_error(const char *fmt, ...) {
   exit(EXIT_FAILURE);
 }
 
+/*
+ * printrequest - Print where request opnum is in its trace: the line of a
+ *     text trace, or the request's number (origin 1) in a binary one
+ */
+static void printrequest(int binary, int opnum) {
+  if (binary)
+    printf("request %d", opnum + 1);
+  else
+    printf("line %d", LINENUM(opnum));
+}
+
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
@@ -1044,23 +3225,173 @@ static void malloc_error(const trace_t *trace, int opnum, const char *fmt,
                          ...) {
   va_list ap;
   va_start(ap, fmt);
-  printf("ERROR [trace %s, line %d]: ", trace->filename, LINENUM(opnum));
+  printf("ERROR [trace %s, ", trace->filename);
+  printrequest(trace->map != NULL, opnum);
+  printf("]: ");
   vprintf(fmt, ap);
   putchar('\n');
   va_end(ap);
 }
 
+/*
+ * printtiming - Summarize the timed runs, if there was more than one
+ */
+static void printtiming(stats_t *stats, int cpu) {
+  if (!stats->valid || timing_reps < 2)
+    return;
+
+  printf("Timed %d runs after %d warmup", timing_reps, timing_warmup);
+  if (cpu >= 0)
+    printf(" on CPU %d", cpu);
+  printf(": min %.6f median %.6f secs, 95%% CI [%.6f, %.6f]\n", stats->secs,
+         stats->secs_median, stats->secs_lo, stats->secs_hi);
+}
+
+/*
+ * printlatency - Print percentiles of each request type's latency
+ */
+static void printlatency(stats_t *stats) {
+  static const char *name[] = {"malloc", "free", "realloc", "", "reset"};
+  static const double pct[] = {0.5, 0.99, 0.999};
+
+  printf("Latency (ns)     ops     p50     p99   p99.9     max  worst\n");
+  for (int type = 0; type <= RESET; type++) {
+    latency_t *lat = &latency[type];
+    if (lat->ops == 0)
+      continue;
+
+    printf("  %-8s %9" PRIu64, name[type], lat->ops);
+    for (int p = 0; p < 3; p++)
+      printf(" %7.0f", lat_percentile(lat, pct[p]) * ns_per_tick);
+    printf(" %7.0f  ", lat->max * ns_per_tick);
+    printrequest(stats->binary, lat->worst);
+    putchar('\n');
+  }
+}
+
+/*
+ * printcounters - Print the mean counts per request of each type
+ */
+static void printcounters(stats_t *stats) {
+  static const char *name[] = {"malloc", "free", "realloc", "", "reset"};
+
+  if (stats->counters_mask == 0) {
+    printf("Performance counters unavailable: %s\n",
+           strerror(stats->counters_error));
+    return;
+  }
+
+  printf("Counters per request     ops");
+  for (int e = 0; e < PERFCTR_NUM; e++)
+    if (stats->counters_mask & (1u << e))
+      printf(" %13s", perfctr_names[e]);
+  putchar('\n');
+
+  for (int type = 0; type <= RESET; type++) {
+    if (stats->counted[type] == 0)
+      continue;
+    printf("  %-12s %11ld", name[type], stats->counted[type]);
+    for (int e = 0; e < PERFCTR_NUM; e++)
+      if (stats->counters_mask & (1u << e))
+        printf(" %13.2f", stats->counters[type][e]);
+    putchar('\n');
+  }
+
+  if (stats->counters_mask != (1u << PERFCTR_NUM) - 1) {
+    printf("Not available:");
+    for (int e = 0; e < PERFCTR_NUM; e++)
+      if (!(stats->counters_mask & (1u << e)))
+        printf(" %s", perfctr_names[e]);
+    putchar('\n');
+  }
+  if (stats->counters_running < 0.999)
+    printf("Counters were multiplexed and counted %.0f%% of the time, "
+           "values are scaled\n",
+           100 * stats->counters_running);
+}
+
+/*
+ * printtouch - Print the costs of the replay that touches the payloads
+ */
+static void printtouch(stats_t *stats) {
+  printf("Touching payloads, walking live blocks %d times: %.1f bytes per "
+         "request\n",
+         stats->touch_walks, stats->touch_bytes);
+  printf("  ns per request: %.1f touching, %.1f in the allocator\n",
+         stats->touch_ns, stats->touch_mm_ns);
+  if (stats->touch_mask == 0)
+    return;
+  printf("  while touching, per request:");
+  for (int e = 0; e < PERFCTR_NUM; e++)
+    if (stats->touch_mask & (1u << e))
+      printf(" %.2f %s", stats->touch_counters[e], perfctr_names[e]);
+  putchar('\n');
+}
+
+/*
+ * printthreads - Print the throughput of the threaded replays and the
+ *     latency percentiles of each thread
+ */
+static void printthreads(void) {
+  static const double pct[] = {0.5, 0.99, 0.999};
+
+  printf("Threaded replay of %d recorded threads, %s calls%s:\n",
+         recorded_threads, mm->name,
+         mm->sim_heap ? " serialized by a lock" : "");
+  for (int n = 1; n <= max_threads; n++) {
+    threadrun_t *run = &thread_runs[n - 1];
+    uint64_t ops = 0;
+
+    for (int i = 0; i < n; i++)
+      ops += run->lat[i].ops;
+    printf("  %d thread%s: %.6f secs, %.0f Kops\n", n, n > 1 ? "s" : "",
+           run->secs, ops / 1e3 / run->secs);
+    printf("    thread       ops     p50     p99   p99.9     max\n");
+    for (int i = 0; i < n; i++) {
+      latency_t *lat = &run->lat[i];
+      printf("    %6d %9" PRIu64, i, lat->ops);
+      for (int p = 0; p < 3; p++)
+        printf(" %7.0f", lat_percentile(lat, pct[p]) * run->ns_per_tick);
+      printf(" %7.0f\n", lat->max * run->ns_per_tick);
+    }
+  }
+}
+
 /*
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-  fprintf(stderr, "Usage: mdriver [-hlVD] [-d <i>] [-v <i>] [-f <file>]\n");
+  fprintf(stderr, "Usage: mdriver [-hlVDHLRPA] [-a <name>] [-b <name>] "
+                  "[-c <cpu>] [-d <i>] [-j <i>] [-k <i>] [-w <i>] [-T <i>] "
+                  "[-u <file>] [-e <i>] [-W <i>] [-O <fmt>] [-B <file>] "
+                  "[-C <file>] [-v <i>] [-t <dir>] [-f <file>] [<file>...]\n");
   fprintf(stderr, "Options\n");
   fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
   fprintf(stderr, "\t-D         Equivalent to -d2.\n");
   fprintf(stderr, "\t-h         Print this message.\n");
   fprintf(stderr, "\t-l         Run libc malloc instead mm.\n");
+  fprintf(stderr, "\t-a <name>  Run allocator <name>, or all; repeat to "
+                  "compare.\n");
+  fprintf(stderr, "\t-L         Print latency percentiles per request.\n");
+  fprintf(stderr, "\t-H         Print hardware counters per request.\n");
+  fprintf(stderr, "\t-T <i>     Replay on 1..<i> threads.\n");
+  fprintf(stderr, "\t-u <file>  Write heap samples to <file> (CSV).\n");
+  fprintf(stderr, "\t-e <i>     Sample the heap every <i> requests.\n");
+  fprintf(stderr, "\t-R         Allocate region-tagged blocks in regions.\n");
+  fprintf(stderr, "\t-b <name>  Heap backend: sim, hugetlb or thp.\n");
+  fprintf(stderr, "\t-P         Pre-fault the heap (MAP_POPULATE).\n");
+  fprintf(stderr, "\t-A         Align heap growth to backing pages.\n");
+  fprintf(stderr, "\t-k <i>     Time <i> runs, report the fastest.\n");
+  fprintf(stderr, "\t-w <i>     Do <i> untimed warmup runs first.\n");
+  fprintf(stderr, "\t-c <cpu>   Pin the driver to <cpu>.\n");
+  fprintf(stderr, "\t-O <fmt>   Print a json or csv record per trace.\n");
+  fprintf(stderr, "\t-W <i>     Touch payloads, walk live blocks every <i> "
+                  "requests.\n");
+  fprintf(stderr, "\t-B <file>  Write the results to baseline <file>.\n");
+  fprintf(stderr, "\t-C <file>  Report regressions from baseline <file>.\n");
   fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
   fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
   fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+  fprintf(stderr, "\t-t <dir>   Use all *.rep and *.bin files in <dir>.\n");
+  fprintf(stderr, "\t-j <i>     Run up to <i> traces in parallel.\n");
 }
@@ -11,33 +11,123 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/resource.h>
 
 #include "memlib.h"
 
+#define HUGE_PAGESIZE (2 * (1 << 20)) /* 2 MiB */
+
 /* private variables */
 static unsigned char *heap;
 static unsigned char *mem_brk;
 static unsigned char *mem_max_addr;
 
+static void *mem_map;     /* mapping that holds the heap */
+static size_t mem_maplen; /* ... and its length */
+
+static mem_backend_t requested = MEM_SIM; /* set by mem_configure */
+static mem_backend_t backend;             /* backend actually in use */
+static int mem_flags;
+static long mem_faults; /* page faults before the heap was ready */
+
+static unsigned char *rss_vec; /* residency of each heap page, see mincore */
+static size_t rss_peak;        /* largest resident size sampled... */
+static double rss_sum;         /* ... and the sum and number of samples */
+static long rss_samples;
+
+static const char *backend_names[] = {"sim", "hugetlb", "thp"};
+
+/* page faults of this process so far, minor and major */
+static long pagefaults(void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_minflt + ru.ru_majflt;
+}
+
+/*
+ * mem_configure - select backend and flags for subsequent mem_init calls
+ */
+void mem_configure(mem_backend_t b, int flags) {
+  requested = b;
+  mem_flags = flags;
+}
+
 /*
  * mem_init - initialize the memory system model
  */
 void mem_init(void) {
-  heap = mmap((void *)0x800000000,    /* suggested start */
-              MAX_HEAP,               /* length */
-              PROT_WRITE,             /* permissions */
-              MAP_PRIVATE | MAP_ANON, /* private or shared? */
-              -1,                     /* fd */
-              0);                     /* offset (dunno) */
+  int populate = (mem_flags & MEM_POPULATE) ? MAP_POPULATE : 0;
+
+  backend = requested;
+  mem_map = MAP_FAILED;
+
+  if (backend == MEM_HUGETLB) {
+    mem_maplen = MAX_HEAP;
+    mem_map = mmap((void *)0x800000000, mem_maplen, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANON | MAP_HUGETLB | populate, -1, 0);
+    if (mem_map == MAP_FAILED) {
+      fprintf(stderr, "WARNING: MAP_HUGETLB failed (%s), using base pages\n",
+              strerror(errno));
+      backend = MEM_SIM;
+    }
+    heap = mem_map;
+  } else if (backend == MEM_THP) {
+    /* Over-map by a huge page, so the heap can start at a 2 MiB boundary. */
+    mem_maplen = MAX_HEAP + HUGE_PAGESIZE;
+    mem_map = mmap((void *)0x800000000, mem_maplen, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (mem_map == MAP_FAILED) {
+      perror("mem_init");
+      exit(EXIT_FAILURE);
+    }
+    heap = (void *)(((size_t)mem_map + HUGE_PAGESIZE - 1) & -HUGE_PAGESIZE);
+    if (madvise(heap, MAX_HEAP, MADV_HUGEPAGE) < 0) {
+      fprintf(stderr, "WARNING: MADV_HUGEPAGE failed (%s), using base pages\n",
+              strerror(errno));
+      backend = MEM_SIM;
+    }
+    /* populate after madvise, so the pages are faulted in as huge pages */
+    if (populate)
+      for (size_t i = 0; i < MAX_HEAP; i += HUGE_PAGESIZE)
+        heap[i] = 0;
+  }
+
+  if (mem_map == MAP_FAILED) {
+    mem_maplen = MAX_HEAP;
+    mem_map = mmap((void *)0x800000000,               /* suggested start */
+                   MAX_HEAP,                          /* length */
+                   PROT_WRITE,                        /* permissions */
+                   MAP_PRIVATE | MAP_ANON | populate, /* private or shared? */
+                   -1,                                /* fd */
+                   0);                                /* offset (dunno) */
+    if (mem_map == MAP_FAILED) {
+      perror("mem_init");
+      exit(EXIT_FAILURE);
+    }
+    heap = mem_map;
+  }
+
   mem_max_addr = heap + MAX_HEAP;
   mem_brk = heap; /* heap is empty initially */
+  mem_faults = pagefaults();
+
+  /* not malloc, so that the heap can back a preloaded malloc (see mm.so) */
+  rss_vec = mmap(NULL, MAX_HEAP / mem_pagesize(), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (rss_vec == MAP_FAILED) {
+    perror("mem_init");
+    exit(EXIT_FAILURE);
+  }
+  rss_peak = rss_samples = 0;
+  rss_sum = 0;
 }
 
 /*
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void) {
-  munmap(heap, MAX_HEAP);
+  munmap(mem_map, mem_maplen);
+  munmap(rss_vec, MAX_HEAP / mem_pagesize());
 }
 
 /*
@@ -57,7 +147,9 @@ void *mem_sbrk(long incr) {
 
   if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
     errno = ENOMEM;
+#ifndef MEM_QUIET
     fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+#endif
     return (void *)-1;
   }
 
@@ -92,3 +184,97 @@ size_t mem_heapsize() {
 size_t mem_pagesize() {
   return (size_t)getpagesize();
 }
+
+/*
+ * mem_backing_pagesize() - returns the size of pages backing the heap
+ */
+size_t mem_backing_pagesize() {
+  if (backend == MEM_SIM)
+    return mem_pagesize();
+  return HUGE_PAGESIZE;
+}
+
+/*
+ * mem_growth_align() - returns the boundary the allocator should align the
+ *    end of the heap to when it calls mem_sbrk, or 0 if it doesn't matter
+ */
+size_t mem_growth_align() {
+  if (!(mem_flags & MEM_ALIGN_GROWTH))
+    return 0;
+  return mem_backing_pagesize();
+}
+
+/*
+ * mem_backend_name() - returns the name of the backend in use
+ */
+const char *mem_backend_name() {
+  return backend_names[backend];
+}
+
+/*
+ * mem_pagefaults() - returns the number of page faults the process has taken
+ *    since mem_init. These include faults outside the heap.
+ */
+long mem_pagefaults() {
+  return pagefaults() - mem_faults;
+}
+
+/*
+ * mem_purge() - gives the backing pages that lie wholly inside [addr,
+ *    addr + len) back to the system. They read as zeros when touched again.
+ */
+void mem_purge(void *addr, size_t len) {
+  size_t page = mem_backing_pagesize();
+  size_t lo = ((size_t)addr + page - 1) & -page;
+  size_t hi = ((size_t)addr + len) & -page;
+
+  if (hi > lo)
+    madvise((void *)lo, hi - lo, MADV_DONTNEED);
+}
+
+/*
+ * mem_rss_reset() - drops all pages of the heap, unless it was populated up
+ *    front, and forgets the samples taken so far
+ */
+void mem_rss_reset() {
+  if (!(mem_flags & MEM_POPULATE))
+    mem_purge(heap, MAX_HEAP);
+  rss_peak = rss_samples = 0;
+  rss_sum = 0;
+}
+
+/*
+ * mem_rss_sample() - returns the number of bytes of the heap that are
+ *    resident, found with mincore, and adds it to the peak and mean
+ */
+size_t mem_rss_sample() {
+  size_t page = mem_pagesize();
+  size_t pages = (mem_heapsize() + page - 1) / page;
+  size_t rss = 0;
+
+  if (pages > 0 && mincore(heap, pages * page, rss_vec) < 0)
+    return 0;
+  for (size_t i = 0; i < pages; i++)
+    rss += rss_vec[i] & 1;
+  rss *= page;
+
+  if (rss > rss_peak)
+    rss_peak = rss;
+  rss_sum += rss;
+  rss_samples++;
+  return rss;
+}
+
+/*
+ * mem_rss_peak() - returns the largest resident size sampled
+ */
+size_t mem_rss_peak() {
+  return rss_peak;
+}
+
+/*
+ * mem_rss_mean() - returns the mean of the resident sizes sampled
+ */
+double mem_rss_mean() {
+  return rss_samples ? rss_sum / rss_samples : 0;
+}
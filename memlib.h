@@ -12,6 +12,19 @@
  */
 #define MAX_HEAP (100 * (1 << 20)) /* 100 MB */
 
+/*
+ * Backing store of the simulated heap
+ */
+typedef enum {
+  MEM_SIM = 0,     /* one plain anonymous mapping with base pages */
+  MEM_HUGETLB = 1, /* explicit 2 MiB pages with MAP_HUGETLB */
+  MEM_THP = 2,     /* transparent huge pages via madvise(MADV_HUGEPAGE) */
+} mem_backend_t;
+
+#define MEM_POPULATE 1     /* pre-fault the heap with MAP_POPULATE */
+#define MEM_ALIGN_GROWTH 2 /* ask the allocator to grow by backing pages */
+
+void mem_configure(mem_backend_t backend, int flags);
 void mem_init(void);
 void mem_deinit(void);
 void *mem_sbrk(long incr);
@@ -20,3 +33,12 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_backing_pagesize(void);
+size_t mem_growth_align(void);
+const char *mem_backend_name(void);
+long mem_pagefaults(void);
+void mem_purge(void *addr, size_t len);
+void mem_rss_reset(void);
+size_t mem_rss_sample(void);
+size_t mem_rss_peak(void);
+double mem_rss_mean(void);
@@ -0,0 +1,334 @@
+/*
+ * microbench.c - time single paths of mm_malloc, mm_free, mm_realloc and
+ * mm_calloc.
+ *
+ * Usage: microbench [-h] [-n <ops>] [-r <rounds>] [<name>...]
+ *
+ * Every benchmark sets up a fresh heap, then times a loop of requests that
+ * all take the same path through the allocator:
+ *
+ *   pingpong   malloc and free of one block, for the largest payload of each
+ *              size class of mm.c
+ *   lifo/fifo  allocate a batch, free it in reverse or in allocation order
+ *   realloc+   grow a block 16 bytes at a time up to 64 KiB
+ *   realloc*2  double a block from 16 bytes up to 1 MiB
+ *   calloc     calloc on pages never used before, and on freed blocks
+ *   coalesce   free blocks whose neighbours on both sides are free
+ *   findfit    malloc that walks a list_more of 1000 blocks, none of which
+ *              fits
+ *
+ * It reports nanoseconds and, where perf events are available, instructions
+ * per request, over <rounds> rounds (best time, mean instructions). Names
+ * given on the command line select the benchmarks to run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "perfctr.h"
+
+/* payloads that fill a block of each size class of mm.c (4-byte header) */
+static const size_t class_sizes[] = {12,  28,   60,   124, 252,
+                                     508, 1020, 2044, 4092};
+
+#define FINDFIT_BLOCKS 1000 /* free blocks on list_more for findfit */
+
+static long nops = 100000; /* requests per round, at most */
+static int rounds = 5;
+
+static void **objs;
+
+static perfctr_t pc;
+static int counting;                 /* are the perf events open? */
+static double start;                 /* time and... */
+static uint64_t before[PERFCTR_NUM]; /* ... events at begin() */
+static double secs;                  /* time of the timed part of a round... */
+static double instrs;                /* ... and the instructions */
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void die(const char *msg) {
+  fprintf(stderr, "microbench: %s\n", msg);
+  exit(EXIT_FAILURE);
+}
+
+static void fresh_heap(void) {
+  mem_reset_brk();
+  if (mm_init() < 0)
+    die("mm_init failed");
+}
+
+/* Number of requests, out of n, whose blocks of size bytes take up at most
+   half of the heap. */
+static long cap(long n, size_t size) {
+  long most = MAX_HEAP / 2 / (size + 2 * ALIGNMENT);
+  return n < most ? n : most;
+}
+
+static void *xmalloc(size_t size) {
+  void *p = mm_malloc(size);
+  if (!p)
+    die("mm_malloc failed");
+  return p;
+}
+
+/* begin and end delimit the timed part of a benchmark */
+static void begin(void) {
+  if (counting)
+    perfctr_read(&pc, before);
+  start = now();
+}
+
+static void end(void) {
+  uint64_t after[PERFCTR_NUM];
+
+  secs += now() - start;
+  if (counting) {
+    perfctr_read(&pc, after);
+    instrs += after[PERFCTR_INSTRUCTIONS] - before[PERFCTR_INSTRUCTIONS];
+  }
+}
+
+static long bench_pingpong(size_t size) {
+  fresh_heap();
+  begin();
+  for (long i = 0; i < nops / 2; i++)
+    mm_free(xmalloc(size));
+  end();
+  return nops / 2 * 2;
+}
+
+static long bench_lifo(size_t size) {
+  long n = cap(nops / 2, size);
+
+  fresh_heap();
+  begin();
+  for (long i = 0; i < n; i++)
+    objs[i] = xmalloc(size);
+  for (long i = n - 1; i >= 0; i--)
+    mm_free(objs[i]);
+  end();
+  return 2 * n;
+}
+
+static long bench_fifo(size_t size) {
+  long n = cap(nops / 2, size);
+
+  fresh_heap();
+  begin();
+  for (long i = 0; i < n; i++)
+    objs[i] = xmalloc(size);
+  for (long i = 0; i < n; i++)
+    mm_free(objs[i]);
+  end();
+  return 2 * n;
+}
+
+/* grow a block of size bytes by size bytes at a time, or double it */
+static long bench_realloc(size_t size, int doubling) {
+  size_t limit = doubling ? 1 << 20 : 64 << 10;
+  long ops = 0;
+
+  fresh_heap();
+  begin();
+  while (ops < nops) {
+    void *p = xmalloc(size);
+    for (size_t s = size; s < limit && ops < nops; ops++) {
+      s = doubling ? 2 * s : s + size;
+      if (!(p = mm_realloc(p, s)))
+        die("mm_realloc failed");
+    }
+    mm_free(p);
+  }
+  end();
+  return ops;
+}
+
+static long bench_realloc_add(size_t size) {
+  return bench_realloc(size, 0);
+}
+
+static long bench_realloc_double(size_t size) {
+  return bench_realloc(size, 1);
+}
+
+/* calloc on untouched pages if fresh, else on the blocks just freed */
+static long bench_calloc(size_t size, int fresh) {
+  long n = cap(nops, size);
+
+  fresh_heap();
+  if (!fresh) {
+    for (long i = 0; i < n; i++)
+      objs[i] = xmalloc(size);
+    for (long i = 0; i < n; i++)
+      mm_free(objs[i]);
+  } else {
+    mem_purge(mem_heap_lo(), MAX_HEAP);
+  }
+
+  begin();
+  for (long i = 0; i < n; i++)
+    if (!(objs[i] = mm_calloc(1, size)))
+      die("mm_calloc failed");
+  end();
+  return n;
+}
+
+static long bench_calloc_fresh(size_t size) {
+  return bench_calloc(size, 1);
+}
+
+static long bench_calloc_reused(size_t size) {
+  return bench_calloc(size, 0);
+}
+
+/* Free the middle block of every triple after the outer ones, so that it
+   merges with free blocks on both sides. */
+static long bench_coalesce(size_t size) {
+  long n = cap(nops, 3 * size);
+
+  fresh_heap();
+  for (long i = 0; i < 3 * n; i++)
+    objs[i] = xmalloc(size);
+  for (long i = 0; i < n; i++) {
+    mm_free(objs[3 * i]);
+    mm_free(objs[3 * i + 2]);
+  }
+
+  begin();
+  for (long i = 0; i < n; i++)
+    mm_free(objs[3 * i + 1]);
+  end();
+  return n;
+}
+
+/* Put free blocks of size bytes on list_more, kept apart by live ones of the
+   same size so that they don't coalesce; then ask for blocks that none of
+   them fits, so that find_fit walks all of them. */
+static long bench_findfit(size_t size) {
+  long n = cap(nops / 100, 2 * size);
+
+  fresh_heap();
+  for (long i = 0; i < 2 * FINDFIT_BLOCKS; i++)
+    objs[i] = xmalloc(size);
+  for (long i = 0; i < FINDFIT_BLOCKS; i++)
+    mm_free(objs[2 * i]);
+
+  begin();
+  for (long i = 0; i < n; i++)
+    xmalloc(2 * size);
+  end();
+  return n;
+}
+
+typedef struct {
+  const char *name;
+  long (*run)(size_t size); /* returns the number of requests timed */
+  size_t size;
+} bench_t;
+
+static const bench_t benches[] = {
+  {"lifo", bench_lifo, 32},
+  {"lifo", bench_lifo, 512},
+  {"fifo", bench_fifo, 32},
+  {"fifo", bench_fifo, 512},
+  {"realloc+", bench_realloc_add, 16},
+  {"realloc*2", bench_realloc_double, 16},
+  {"calloc-fresh", bench_calloc_fresh, 256},
+  {"calloc-reused", bench_calloc_reused, 256},
+  {"coalesce", bench_coalesce, 64},
+  {"findfit", bench_findfit, 5000},
+};
+
+static int selected(const char *name, char **names, int n) {
+  for (int i = 0; i < n; i++)
+    if (!strncmp(name, names[i], strlen(names[i])))
+      return 1;
+  return n == 0;
+}
+
+static void run(const char *name, long (*f)(size_t), size_t size) {
+  double best = 0, instr_sum = 0;
+  long ops = 0;
+
+  for (int r = 0; r < rounds; r++) {
+    secs = instrs = 0;
+    ops = f(size);
+    if (r == 0 || secs < best)
+      best = secs;
+    instr_sum += instrs;
+  }
+
+  printf("%-14s %6zu %9ld %9.1f", name, size, ops, best * 1e9 / ops);
+  if (counting)
+    printf(" %9.1f\n", instr_sum / rounds / ops);
+  else
+    printf(" %9s\n", "-");
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: microbench [-h] [-n <ops>] [-r <rounds>] "
+                  "[<name>...]\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "\t-n <i>     Time <i> requests per round.\n");
+  fprintf(stderr, "\t-r <i>     Run <i> rounds.\n");
+}
+
+int main(int argc, char **argv) {
+  int c;
+  while ((c = getopt(argc, argv, "hn:r:")) != EOF) {
+    switch (c) {
+      case 'n':
+        nops = atol(optarg);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      case 'h':
+        usage();
+        exit(EXIT_SUCCESS);
+      default:
+        usage();
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (nops < 100 || rounds < 1) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+
+  if (!(objs = malloc((3 * nops + 2 * FINDFIT_BLOCKS) * sizeof(void *)))) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  counting = perfctr_open(&pc) > 0 && (pc.mask & (1u << PERFCTR_INSTRUCTIONS));
+
+  mem_init();
+
+  char **names = argv + optind;
+  int nnames = argc - optind;
+  printf("%-14s %6s %9s %9s %9s\n", "benchmark", "size", "ops", "ns/op",
+         "instr/op");
+  if (selected("pingpong", names, nnames))
+    for (size_t i = 0; i < sizeof(class_sizes) / sizeof(class_sizes[0]); i++)
+      run("pingpong", bench_pingpong, class_sizes[i]);
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+    if (selected(benches[i].name, names, nnames))
+      run(benches[i].name, benches[i].run, benches[i].size);
+  if (!counting)
+    printf("Instructions can't be counted: %s\n", strerror(pc.error));
+
+  mem_deinit();
+  perfctr_close(&pc);
+  free(objs);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,510 @@
+/*
+ * mm-buddy.c - binary buddy allocator.
+ *
+ * Every block has a size that is a power of two (its order) and starts at an
+ * offset from the arena base that is a multiple of its size. The buddy of a
+ * block is found by flipping the order bit of its offset, so coalescing never
+ * needs footers or neighbour walks. Blocks carry a single 4-byte header with
+ * the block size and USED flag, exactly like boundary tags in mm.c.
+ *
+ * Free blocks of each order are kept on a circular doubly linked list whose
+ * links are 4-byte offsets stored in the payload. A bitmap tells which lists
+ * are non-empty, so finding the smallest order that can satisfy a request is
+ * a single count-trailing-zeros. List heads and the bitmap live in a header at
+ * the start of the heap to keep .data and .bss small.
+ *
+ * The arena grows lazily. To allocate a block of order k past the end of the
+ * arena, the end is first rounded up to a multiple of 2^k, and every gap block
+ * created on the way is put on a free list. When that padding would be larger
+ * than the arena built so far (e.g. a huge request after a few small ones), a
+ * new zone is opened instead at the current brk. Each zone is a separate buddy
+ * system with its own base, so the padding never has to be paid.
+ */
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* If you want debugging output, use the following macro.
+ * When you hand in, remove the #define DEBUG line. */
+
+// #define CHECKHEAP
+#define VERBOSE 1
+// #define DEBUG
+
+#ifdef DEBUG
+#define debug(fmt, ...) printf("%s: " fmt "\n", __func__, __VA_ARGS__)
+#define msg(...) printf(__VA_ARGS__)
+#else
+#define debug(fmt, ...)
+#define msg(...)
+#endif
+
+#ifdef CHECKHEAP
+#define checkheap() mm_checkheap(VERBOSE)
+#else
+#define checkheap()
+#endif
+
+#define __unused __attribute__((unused))
+
+/* do not change the following! */
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#endif /* !DRIVER */
+
+typedef int32_t word_t; /* Heap is bascially an array of 4-byte words. */
+
+typedef enum {
+  FREE = 0, /* Block is free */
+  USED = 1, /* Block is used */
+} bt_flags;
+
+#define MIN_ORDER 4  /* 16 bytes: header + two free list links */
+#define MAX_ORDER 27 /* 128 MiB, more than MAX_HEAP */
+#define MAX_ZONES 8
+
+typedef struct {
+  word_t start; /* offset of the zone from the arena base */
+  word_t size;  /* bytes in the zone, only the last zone grows */
+} zone_t;
+
+/* Heap header placed by mm_init in front of the arena. */
+typedef struct {
+  uint32_t nonempty;           /* bit k is set iff list of order k has blocks */
+  word_t heads[MAX_ORDER + 1]; /* offset of the first block of each order */
+  int nzones;                  /* number of zones in use */
+  zone_t zones[MAX_ZONES];
+} buddy_hdr_t;
+
+static buddy_hdr_t *hdr; /* Free list heads, bitmap and zones */
+static void *base;       /* Arena base, offsets are counted from here */
+static size_t arena;     /* Arena size in bytes */
+
+/* --=[ boundary tag handling ]=-------------------------------------------- */
+
+static inline int bt_used(word_t *bt) {
+  return *bt & USED;
+}
+
+static inline int bt_free(word_t *bt) {
+  return !(*bt & USED);
+}
+
+static inline size_t bt_size(word_t *bt) {
+  return *bt & -ALIGNMENT;
+}
+
+static inline int bt_order(word_t *bt) {
+  return __builtin_ctzl(bt_size(bt));
+}
+
+/* Given payload pointer returns an address of boundary tag. */
+static inline word_t *bt_fromptr(void *ptr) {
+  return (word_t *)ptr - 1;
+}
+
+/* Creates boundary tag for given block. */
+static inline void bt_make(word_t *bt, int order, bt_flags flags) {
+  *bt = (1 << order) | flags;
+}
+
+/* Returns address of payload. */
+static inline void *bt_payload(word_t *bt) {
+  return bt + 1;
+}
+
+/* Offset of a block from the arena base. */
+static inline size_t bt_offset(word_t *bt) {
+  return (void *)bt - base;
+}
+
+static inline word_t *bt_at(size_t offset) {
+  return base + offset;
+}
+
+/* Returns the zone containing given offset. Most blocks live in the last
+ * zone, so we search backwards. */
+static inline zone_t *zone_of(size_t offset) {
+  zone_t *z = &hdr->zones[hdr->nzones - 1];
+  while (offset < z->start)
+    z--;
+  return z;
+}
+
+/* Returns address of the buddy of a block of given order or NULL if the buddy
+ * lies (partially) past the end of its zone. */
+static inline word_t *bt_buddy(word_t *bt, int order) {
+  size_t size = (size_t)1 << order;
+  zone_t *z = zone_of(bt_offset(bt));
+  size_t rel = (bt_offset(bt) - z->start) ^ size;
+  if (rel + size > z->size)
+    return NULL;
+  return bt_at(z->start + rel);
+}
+
+/* --=[ free list ]=-------------------------------------------------------- */
+
+static inline word_t *fl_next(word_t *bt) {
+  return bt_at(bt[1]);
+}
+
+static inline word_t *fl_prev(word_t *bt) {
+  return bt_at(bt[2]);
+}
+
+static inline void fl_set_next(word_t *bt, word_t *next) {
+  bt[1] = bt_offset(next);
+}
+
+static inline void fl_set_prev(word_t *bt, word_t *prev) {
+  bt[2] = bt_offset(prev);
+}
+
+static inline int fl_empty(int order) {
+  return !(hdr->nonempty & (1U << order));
+}
+
+/* put free block at the front of the list for its order */
+static inline void fl_add(word_t *bt, int order) {
+  if (fl_empty(order)) {
+    fl_set_next(bt, bt);
+    fl_set_prev(bt, bt);
+    hdr->nonempty |= 1U << order;
+  } else {
+    word_t *next = bt_at(hdr->heads[order]);
+    word_t *prev = fl_prev(next);
+    fl_set_next(prev, bt);
+    fl_set_next(bt, next);
+    fl_set_prev(bt, prev);
+    fl_set_prev(next, bt);
+  }
+  hdr->heads[order] = bt_offset(bt);
+}
+
+static inline void fl_remove(word_t *bt, int order) {
+  word_t *next = fl_next(bt);
+  if (next == bt) {
+    hdr->nonempty &= ~(1U << order);
+    return;
+  }
+  word_t *prev = fl_prev(bt);
+  fl_set_next(prev, next);
+  fl_set_prev(next, prev);
+  if (hdr->heads[order] == bt_offset(bt))
+    hdr->heads[order] = bt_offset(next);
+}
+
+/* search free list of given order for the block, return true if it's there */
+static int fl_search(word_t *bt, int order) {
+  if (fl_empty(order))
+    return 0;
+  word_t *head = bt_at(hdr->heads[order]);
+  word_t *i = head;
+  do {
+    if (i == bt)
+      return 1;
+    i = fl_next(i);
+  } while (i != head);
+  return 0;
+}
+
+/* --=[ miscellanous procedures ]=------------------------------------------ */
+
+/* Calculates the smallest order of a block that fits header & payload. */
+static inline int blkorder(size_t size) {
+  size_t reqsz = size + sizeof(word_t);
+  if (reqsz <= (1 << MIN_ORDER))
+    return MIN_ORDER;
+  return 64 - __builtin_clzl(reqsz - 1);
+}
+
+static void *morecore(size_t size) {
+  void *ptr = mem_sbrk(size);
+  if (ptr == (void *)-1)
+    return NULL;
+  return ptr;
+}
+
+/* Coalesce free block with its buddies as long as possible and put the result
+ * on a free list. */
+static void release(word_t *bt, int order) {
+  while (order < MAX_ORDER) {
+    word_t *buddy = bt_buddy(bt, order);
+    if (!buddy || bt_used(buddy) || bt_order(buddy) != order)
+      break;
+    fl_remove(buddy, order);
+    if (buddy < bt)
+      bt = buddy;
+    order++;
+  }
+  bt_make(bt, order, FREE);
+  fl_add(bt, order);
+}
+
+/* Extend the arena with a block of given order. The end of the last zone is
+ * first aligned to the block size, gap blocks go to the free lists. */
+static word_t *grow(int order) {
+  size_t size = (size_t)1 << order;
+  zone_t *z = &hdr->zones[hdr->nzones - 1];
+  size_t padding = -(size_t)z->size & (size - 1);
+  if (padding > z->size && hdr->nzones < MAX_ZONES) {
+    msg("new zone\n");
+    z++;
+    z->start = arena;
+    z->size = 0;
+    hdr->nzones++;
+  }
+  while (z->size & (size - 1)) {
+    size_t gap = z->size & -z->size;
+    if (!morecore(gap))
+      return NULL;
+    word_t *bt = bt_at(arena);
+    arena += gap;
+    z->size += gap;
+    release(bt, __builtin_ctzl(gap));
+  }
+  if (!morecore(size))
+    return NULL;
+  word_t *bt = bt_at(arena);
+  arena += size;
+  z->size += size;
+  return bt;
+}
+
+/* --=[ mm_init ]=---------------------------------------------------------- */
+
+int mm_init(void) {
+  /* Place the arena so that payloads (base + 4) are aligned. */
+  size_t hdrsz = (sizeof(buddy_hdr_t) + sizeof(word_t) + ALIGNMENT - 1) &
+                 -ALIGNMENT;
+  void *ptr = morecore(hdrsz - sizeof(word_t));
+  if (!ptr)
+    return -1;
+
+  hdr = ptr;
+  hdr->nonempty = 0;
+  hdr->nzones = 1;
+  hdr->zones[0].start = 0;
+  hdr->zones[0].size = 0;
+  base = ptr + hdrsz - sizeof(word_t);
+  arena = 0;
+
+  return 0;
+}
+
+/* --=[ malloc ]=----------------------------------------------------------- */
+
+void *malloc(size_t size) {
+  int order = blkorder(size);
+  if (order > MAX_ORDER)
+    return NULL;
+  debug("MALLOC size: %ld, order: %d", size, order);
+
+  word_t *bt;
+  uint32_t fit = hdr->nonempty & -(1U << order);
+  if (fit) {
+    int j = __builtin_ctz(fit);
+    bt = bt_at(hdr->heads[j]);
+    fl_remove(bt, j);
+    /* split, upper halves go to free lists */
+    while (j > order) {
+      j--;
+      word_t *half = (void *)bt + ((size_t)1 << j);
+      bt_make(half, j, FREE);
+      fl_add(half, j);
+    }
+  } else {
+    bt = grow(order);
+    if (!bt)
+      return NULL;
+  }
+
+  bt_make(bt, order, USED);
+  checkheap();
+  return bt_payload(bt);
+}
+
+/* --=[ free ]=------------------------------------------------------------- */
+
+void free(void *ptr) {
+  if (!ptr)
+    return;
+
+  word_t *bt = bt_fromptr(ptr);
+  debug("FREE offset: %ld, size: %ld", bt_offset(bt), bt_size(bt));
+  release(bt, bt_order(bt));
+  checkheap();
+}
+
+/* --=[ realloc ]=---------------------------------------------------------- */
+
+/* Try to grow a used block in place to given order by absorbing the right
+ * buddies of all intermediate orders, or by extending the arena when the block
+ * ends at the arena boundary. */
+static int grow_inplace(word_t *bt, int order) {
+  zone_t *z = zone_of(bt_offset(bt));
+  size_t rel = bt_offset(bt) - z->start;
+  size_t end = rel + ((size_t)1 << order);
+  if (rel & (((size_t)1 << order) - 1))
+    return 0; /* block is not the leftmost part of the larger block */
+
+  int j;
+  for (j = bt_order(bt); j < order; j++) {
+    size_t next = rel + ((size_t)1 << j);
+    if (next >= z->size)
+      break; /* rest of the block lies past the zone */
+    word_t *buddy = bt_at(z->start + next);
+    if (bt_used(buddy) || bt_order(buddy) != j)
+      return 0;
+  }
+
+  if (j < order) {
+    if (z != &hdr->zones[hdr->nzones - 1] || !morecore(end - z->size))
+      return 0;
+  }
+
+  for (j = bt_order(bt); j < order; j++) {
+    size_t next = rel + ((size_t)1 << j);
+    if (next >= z->size)
+      break;
+    fl_remove(bt_at(z->start + next), j);
+  }
+
+  if (end > z->size) {
+    arena += end - z->size;
+    z->size = end;
+  }
+  bt_make(bt, order, USED);
+  return 1;
+}
+
+void *realloc(void *old_ptr, size_t size) {
+  /* If size == 0 then this is just free, and we return NULL. */
+  if (size == 0) {
+    free(old_ptr);
+    return NULL;
+  }
+
+  /* If old_ptr is NULL, then this is just malloc. */
+  if (!old_ptr)
+    return malloc(size);
+
+  word_t *bt = bt_fromptr(old_ptr);
+  int order = blkorder(size);
+  debug("REALLOC offset: %ld, old order: %d, new order %d", bt_offset(bt),
+        bt_order(bt), order);
+
+  /* If old block is enough, we can just return it */
+  if (order <= bt_order(bt))
+    return old_ptr;
+
+  if (order <= MAX_ORDER && grow_inplace(bt, order)) {
+    checkheap();
+    return old_ptr;
+  }
+
+  void *new_ptr = malloc(size);
+  /* If malloc() fails, the original block is left untouched. */
+  if (!new_ptr)
+    return NULL;
+
+  /* Copy the old data. */
+  memcpy(new_ptr, old_ptr, bt_size(bt) - sizeof(word_t));
+
+  /* Free the old block. */
+  free(old_ptr);
+
+  return new_ptr;
+}
+
+/* --=[ calloc ]=----------------------------------------------------------- */
+
+void *calloc(size_t nmemb, size_t size) {
+  size_t bytes = nmemb * size;
+  void *new_ptr = malloc(bytes);
+  if (new_ptr)
+    memset(new_ptr, 0, bytes);
+  return new_ptr;
+}
+
+/* --=[ mm_checkheap ]=----------------------------------------------------- */
+
+void mm_checkheap(int verbose) { /* verbose=0: check only; verbose=1: print and
+                                    check; verbose=2: print only */
+  if (verbose) {
+    int i = 0;
+    msg("\nHEAP\n");
+    for (size_t off = 0; off < arena; off += bt_size(bt_at(off)), i++) {
+      debug("block number %d, offset: %ld, order: %d, used: %d", i, off,
+            bt_order(bt_at(off)), bt_used(bt_at(off)));
+      if (i > 100)
+        break;
+    }
+    msg("\nZONES %d, FREE LISTS %x\n", hdr->nzones, hdr->nonempty);
+  }
+  if (verbose < 2) {
+    size_t nfree = 0;
+    for (size_t off = 0; off < arena; off += bt_size(bt_at(off))) {
+      word_t *bt = bt_at(off);
+      int order = bt_order(bt);
+      size_t rel = off - zone_of(off)->start;
+
+      /* Blocks are powers of two, aligned to their size within the zone */
+      if (order < MIN_ORDER || order > MAX_ORDER ||
+          bt_size(bt) != ((size_t)1 << order) || (rel & (bt_size(bt) - 1))) {
+        perror("misplaced block\n");
+        exit(EXIT_FAILURE);
+      }
+
+      if (bt_used(bt))
+        continue;
+      nfree++;
+
+      /* Every free block is on the free list of its order */
+      if (!fl_search(bt, order)) {
+        perror("free block not in free list\n");
+        exit(EXIT_FAILURE);
+      }
+
+      /* There are no two free buddies of the same order */
+      word_t *buddy = bt_buddy(bt, order);
+      if (buddy && bt_free(buddy) && bt_order(buddy) == order) {
+        perror("two free buddies not coalesced\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    /* Every block on the free lists is marked FREE and has matching order */
+    for (int order = MIN_ORDER; order <= MAX_ORDER; order++) {
+      if (fl_empty(order))
+        continue;
+      word_t *head = bt_at(hdr->heads[order]);
+      word_t *b = head;
+      do {
+        if (bt_used(b) || bt_order(b) != order) {
+          perror("bad block in free list\n");
+          exit(EXIT_FAILURE);
+        }
+        nfree--;
+        b = fl_next(b);
+      } while (b != head);
+    }
+
+    if (nfree) {
+      perror("free lists and heap disagree\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
@@ -11,8 +11,17 @@
 #include "mm.h"
 #include "memlib.h"
 
-// best sbrk_min = 512
+/* Tunable parameters; tune.py searches them and writes the best ones to
+ * mm-config.h, which the Makefile includes before this file. Valid values:
+ * SBRK_MIN a multiple of ALIGNMENT, SLACK_DIV >= 1, and LISTNUM_MAX (below)
+ * a power of two from 16 to 8192. */
+#ifndef SBRK_MIN
 #define SBRK_MIN 512
+#endif
+/* blocks growing with realloc get 1/SLACK_DIV of their size as slack */
+#ifndef SLACK_DIV
+#define SLACK_DIV 2
+#endif
 #define MIN(x, y) (x < y) ? x : y
 #define MAX(x, y) (x > y) ? x : y
 
@@ -54,6 +63,7 @@ typedef enum {
   FREE = 0,     /* Block is free */
   USED = 1,     /* Block is used */
   PREVFREE = 2, /* Previous block is free (optimized boundary tags) */
+  GROWING = 4,  /* Block is growing with realloc and may have slack */
 } bt_flags;
 
 static word_t *heap_start; /* Address of the first block */
@@ -61,9 +71,17 @@ static word_t *heap_end;   /* Address past last byte of last block */
 static word_t *last;       /* Points at last block */
 
 static word_t *free_list; /* Pointer to the first block in free list */
+static word_t *grower;    /* The block that got slack in the last realloc */
 
-static int start_class;
-#define LISTNUM_MAX 8192 // 16384
+/* largest size class with its own list, a power of two up to 8192 */
+#ifndef LISTNUM_MAX
+#define LISTNUM_MAX 8192
+#endif
+
+#if SBRK_MIN % ALIGNMENT || SLACK_DIV < 1 || LISTNUM_MAX < 16 ||              \
+  LISTNUM_MAX > 8192 || (LISTNUM_MAX & (LISTNUM_MAX - 1))
+#error "SBRK_MIN, SLACK_DIV or LISTNUM_MAX out of range"
+#endif
 
 /* one list of free blocks + pointers to the following size classes on the list
  */
@@ -149,6 +167,16 @@ static inline word_t *bt_prev(word_t *bt) {
   return (void *)prev_footer - bt_size(prev_footer) + sizeof(word_t);
 }
 
+/* Requested payload size of a GROWING block. It's stored in the last word of
+ * the block, which is part of the slack. */
+static inline size_t bt_get_reqsize(word_t *bt) {
+  return *bt_footer(bt);
+}
+
+static inline void bt_set_reqsize(word_t *bt, size_t size) {
+  *bt_footer(bt) = size;
+}
+
 /* --=[ free list ]=-------------------------------------------- */
 
 /* round up to nearest power of 2; if result > LISTNUM_MAX return LISTNUM_MAX */
@@ -269,7 +297,13 @@ static inline void fl_add(word_t *bt) {
       }
       /* if there are no larger blocks, put the block at the end of free list */
       if (!next) {
-        next = free_list;
+        word_t *prev = fl_prev(free_list);
+        fl_set_next(prev, bt);
+        fl_set_next(bt, free_list);
+        fl_set_prev(bt, prev);
+        fl_set_prev(free_list, bt);
+        *list = bt;
+        return;
       }
     }
     word_t *prev = fl_prev(next);
@@ -278,10 +312,9 @@ static inline void fl_add(word_t *bt) {
     fl_set_prev(bt, prev);
     fl_set_prev(next, bt);
     *list = bt;
-    if (listnum < start_class) {
-      start_class = listnum;
+    /* block went in front of the smallest one, free list must start here */
+    if (next == free_list)
       free_list = bt;
-    }
   }
 }
 
@@ -355,6 +388,21 @@ static void *morecore(size_t size) {
   return ptr;
 }
 
+/* Calculates how much to take from morecore for a block of reqsz bytes.
+ * Small blocks take SBRK_MIN. If memlib asks for aligned growth, the heap end
+ * is moved up to a backing page boundary (less the word that keeps payloads
+ * aligned), so the allocator doesn't touch a page it only partially uses. */
+static inline size_t growsz(size_t reqsz) {
+  size_t size = MAX(reqsz, SBRK_MIN);
+  size_t align = mem_growth_align();
+  if (align) {
+    size_t brk = mem_heapsize();
+    size_t end = (brk + size + sizeof(word_t) + align - 1) & -align;
+    size = end - sizeof(word_t) - brk;
+  }
+  return size;
+}
+
 /* --=[ mm_init ]=---------------------------------------------------------- */
 
 int mm_init(void) {
@@ -367,6 +415,7 @@ int mm_init(void) {
   last = NULL;
 
   free_list = NULL;
+  grower = NULL;
   list16 = NULL;
   list32 = NULL;
   list64 = NULL;
@@ -384,25 +433,31 @@ int mm_init(void) {
 
 /* --=[ malloc ]=----------------------------------------------------------- */
 
+/* Returns NULL if the heap can't grow. */
 static word_t *alloc_with_sbrk(size_t reqsz) {
   msg("alloc using morecore\n");
+  size_t growth = growsz(reqsz);
 
   if (!heap_start) {
     msg("\n!heap_start!\n");
-    if (reqsz < SBRK_MIN) {
+    if (reqsz < growth) {
       msg("small block\n");
-      word_t *res = morecore(SBRK_MIN);
+      word_t *res = morecore(growth);
+      if (!res)
+        return NULL;
       word_t *next = (void *)res + reqsz;
       heap_start = res;
       last = next;
-      heap_end = (void *)res + SBRK_MIN;
+      heap_end = (void *)res + growth;
       bt_make(res, reqsz, USED);
-      bt_make(next, SBRK_MIN - reqsz, FREE);
-      bt_make(bt_footer(next), SBRK_MIN - reqsz, FREE);
+      bt_make(next, growth - reqsz, FREE);
+      bt_make(bt_footer(next), growth - reqsz, FREE);
       fl_add(next);
       return res;
     }
     word_t *res = morecore(reqsz);
+    if (!res)
+      return NULL;
     last = res;
     heap_end = (void *)last + reqsz;
     heap_start = res;
@@ -410,26 +465,30 @@ static word_t *alloc_with_sbrk(size_t reqsz) {
     return res;
   }
 
-  if (reqsz < SBRK_MIN) {
+  if (reqsz < growth) {
     msg("small block\n");
-    word_t *res = morecore(SBRK_MIN);
+    word_t *res = morecore(growth);
+    if (!res)
+      return NULL;
     word_t *next = (void *)res + reqsz;
     bt_flags pf = bt_free(last);
     last = next;
-    heap_end = (void *)res + SBRK_MIN;
+    heap_end = (void *)res + growth;
     bt_make(res, reqsz, USED);
     if (pf)
       bt_set_prevfree(res);
     else
       bt_clr_prevfree(res);
-    bt_make(next, SBRK_MIN - reqsz, FREE);
-    bt_make(bt_footer(next), SBRK_MIN - reqsz, FREE);
+    bt_make(next, growth - reqsz, FREE);
+    bt_make(bt_footer(next), growth - reqsz, FREE);
     fl_add(next);
     return res;
   }
 
   bt_flags pf = bt_free(last);
   word_t *res = morecore(reqsz);
+  if (!res)
+    return NULL;
   last = res;
   heap_end = (void *)last + reqsz;
   bt_make(res, reqsz, USED);
@@ -479,13 +538,39 @@ static word_t *find_fit(size_t reqsz) {
   return NULL;
 }
 
+/* Returns the slack of a GROWING block to the free lists. */
+static void trim_slack(word_t *bt) {
+  size_t size = blksz(bt_get_reqsize(bt));
+  size_t slack = bt_size(bt) - size;
+  debug("TRIM offset: %ld, slack: %ld", (long)bt - (long)heap_start, slack);
+  if (bt == grower)
+    grower = NULL;
+  bt_make(bt, size, bt_getflags(bt) & ~GROWING);
+  if (!slack)
+    return;
+  /* Not split_block: its footer would overwrite the end of the payload. */
+  word_t *rest = (void *)bt + size;
+  bt_make(rest, slack, USED);
+  if (bt == last)
+    last = rest;
+  free(bt_payload(rest));
+}
+
 void *malloc(size_t size) {
+  /* block sizes must fit in a boundary tag */
+  if (size > INT_MAX - 2 * ALIGNMENT)
+    return NULL;
   size_t reqsz = blksz(size);
   debug("MALLOC size: %ld", reqsz);
   word_t *fit = find_fit(reqsz);
-  if (!fit) {
-    fit = alloc_with_sbrk(reqsz);
+  /* Rather take back slack of a growing block than extend the heap. */
+  if (!fit && grower &&
+      bt_size(grower) - blksz(bt_get_reqsize(grower)) >= reqsz) {
+    trim_slack(grower);
+    fit = find_fit(reqsz);
   }
+  if (!fit && !(fit = alloc_with_sbrk(reqsz)))
+    return NULL;
   word_t *next = bt_next(fit);
   if (next)
     bt_clr_prevfree(next);
@@ -496,19 +581,15 @@ void *malloc(size_t size) {
 
 /* --=[ free ]=------------------------------------------------------------- */
 
-void free(void *ptr) {
-  if (!ptr)
-    return;
-
-  word_t *bt = bt_fromptr(ptr);
-  debug("FREE offset: %ld, size: %ld", (long)bt - (long)heap_start,
-        bt_size(bt));
-  bt_make(bt, bt_size(bt), FREE | bt_get_prevfree(bt));
-  word_t *footer = bt_footer(bt);
-  bt_make(footer, bt_size(bt), FREE | bt_get_prevfree(bt));
+/* Frees block bt, which is size bytes long. */
+static inline void free_block(word_t *bt, size_t size) {
+  debug("FREE offset: %ld, size: %ld", (long)bt - (long)heap_start, size);
+  bt_make(bt, size, FREE | bt_get_prevfree(bt));
+  word_t *footer = (void *)bt + size - sizeof(word_t);
+  bt_make(footer, size, FREE | bt_get_prevfree(bt));
 
-  word_t *next = bt_next(bt);
-  if (next && bt_free(next)) {
+  word_t *next = (void *)bt + size;
+  if (next != heap_end && bt_free(next)) {
     fl_remove(next);
     merge_blocks(bt, next);
   }
@@ -527,6 +608,16 @@ void free(void *ptr) {
   checkheap();
 }
 
+void free(void *ptr) {
+  if (!ptr)
+    return;
+
+  word_t *bt = bt_fromptr(ptr);
+  if (bt == grower)
+    grower = NULL;
+  free_block(bt, bt_size(bt));
+}
+
 /* --=[ realloc ]=---------------------------------------------------------- */
 
 void *realloc(void *old_ptr, size_t size) {
@@ -544,34 +635,55 @@ void *realloc(void *old_ptr, size_t size) {
   if (!old_ptr)
     return malloc(size);
 
-  /* If old block is enough, we can just return it */
   word_t *bt = bt_fromptr(old_ptr);
-  if (bt_size(bt) - sizeof(word_t) >= size)
+  int growing = bt_getflags(bt) & GROWING;
+  size_t old_size =
+    growing ? bt_get_reqsize(bt) : bt_size(bt) - sizeof(word_t);
+
+  if (growing) {
+    /* The block stopped growing, we don't need the slack anymore */
+    if (size <= old_size) {
+      bt_set_reqsize(bt, size);
+      trim_slack(bt);
+      return old_ptr;
+    }
+    /* Slack is enough, but keep the last word for requested size */
+    if (size + 2 * sizeof(word_t) <= bt_size(bt)) {
+      bt_set_reqsize(bt, size);
+      return old_ptr;
+    }
+  } else if (size <= old_size) {
+    /* If old block is enough, we can just return it */
     return old_ptr;
+  }
 
-  /* If it's the last block we can use morecore */
-  // if (bt == last) {
-  //   size_t reqsz = blksz(size - bt_size(bt));
-  //   morecore(reqsz);
-  //   bt_make(bt, bt_size(bt) + reqsz, bt_getflags(bt));
-  //   heap_end = (void *)bt + bt_size(bt);
-  // }
-  /* That turned out to be a bad idea :( */
+  /* The block grows. Make room for requested size in the last word and, if
+   * it has grown before, add slack proportional to its size. Only one block
+   * keeps slack, the previous one has likely stopped growing. */
+  size_t reqsz = blksz(size + sizeof(word_t));
+  size_t wantsz = reqsz;
+  /* with SLACK_DIV > 2 the slack can be less than the word for the size */
+  if (growing)
+    wantsz = MAX(reqsz, blksz(size + size / SLACK_DIV));
+  if (growing && grower && grower != bt)
+    trim_slack(grower);
 
   /* If next block is free we can merge it with old block */
   word_t *next = bt_next(bt);
-  size_t reqsz = blksz(size);
-  if (next && bt_free(next) &&
-      bt_size(bt) + bt_size(next) - sizeof(word_t) >= reqsz) {
-    size_t addsize = reqsz - bt_size(bt);
-    if (bt_size(next) - addsize > 0) {
-      fl_remove(next);
-      split_block(next, addsize);
+  if (next && bt_free(next) && bt_size(bt) + bt_size(next) >= reqsz) {
+    size_t total = bt_size(bt) + bt_size(next);
+    size_t newsz = MIN(wantsz, total);
+    fl_remove(next);
+    if (total > newsz) {
+      split_block(next, newsz - bt_size(bt));
       fl_add(bt_next(next));
     }
 
-    // fl_remove(next);
     merge_blocks(bt, next);
+    bt_make(bt, bt_size(bt), bt_getflags(bt) | GROWING);
+    bt_set_reqsize(bt, size);
+    if (growing)
+      grower = bt;
 
     next = bt_next(bt);
     if (next)
@@ -580,16 +692,29 @@ void *realloc(void *old_ptr, size_t size) {
     return old_ptr;
   }
 
-  void *new_ptr = malloc(size);
+  /* If it's the last block we can use morecore */
+  if (bt == last && morecore(reqsz - bt_size(bt))) {
+    bt_make(bt, reqsz, bt_getflags(bt) | GROWING);
+    heap_end = (void *)bt + bt_size(bt);
+    bt_set_reqsize(bt, size);
+    if (growing)
+      grower = bt;
+    checkheap();
+    return old_ptr;
+  }
+
+  void *new_ptr = malloc(wantsz - sizeof(word_t));
   /* If malloc() fails, the original block is left untouched. */
   if (!new_ptr)
     return NULL;
 
+  word_t *new_bt = bt_fromptr(new_ptr);
+  bt_make(new_bt, bt_size(new_bt), bt_getflags(new_bt) | GROWING);
+  bt_set_reqsize(new_bt, size);
+  if (growing)
+    grower = new_bt;
+
   /* Copy the old data. */
-  // word_t *bt = bt_fromptr(old_ptr);
-  size_t old_size = bt_size(bt);
-  if (size < old_size)
-    old_size = size;
   memcpy(new_ptr, old_ptr, old_size);
 
   /* Free the old block. */
@@ -608,6 +733,57 @@ void *calloc(size_t nmemb, size_t size) {
   return new_ptr;
 }
 
+#ifdef MM_EXTENSIONS
+/* --=[ aligned allocation & sized free ]=---------------------------------- */
+
+/* Allocates size bytes aligned to alignment, a power of two. The block is cut
+ * out of one that is alignment bytes longer, and the space in front of and
+ * behind it goes back to the free lists. Payloads are ALIGNMENT aligned, so
+ * that space is either empty or long enough for a free block. */
+void *mm_aligned_alloc(size_t alignment, size_t size) {
+  if (alignment & (alignment - 1))
+    return NULL;
+  if (alignment <= ALIGNMENT)
+    return malloc(size);
+  if (alignment > INT_MAX / 2 || size > INT_MAX - 2 * alignment)
+    return NULL;
+
+  size_t reqsz = blksz(size);
+  void *ptr = malloc(reqsz + alignment);
+  if (!ptr)
+    return NULL;
+
+  word_t *bt = bt_fromptr(ptr);
+  size_t front = -(uintptr_t)ptr & (alignment - 1);
+  word_t *abt = (void *)bt + front;
+  /* there are always at least ALIGNMENT bytes behind the aligned block */
+  word_t *rest = (void *)abt + reqsz;
+  size_t back = bt_size(bt) - front - reqsz;
+  bt_make(bt, front + reqsz, bt_getflags(bt));
+  bt_make(rest, back, USED);
+  if (bt == last)
+    last = rest;
+  free_block(rest, back);
+
+  if (front) {
+    bt_make(bt, front, bt_getflags(bt));
+    bt_make(abt, reqsz, USED);
+    free_block(bt, front);
+  }
+  return bt_payload(abt);
+}
+
+/* Every block from malloc, calloc or mm_aligned_alloc is exactly blksz(size)
+ * bytes long, so the size the caller passes back saves decoding the boundary
+ * tag. Blocks passed to realloc may be longer, they need free. */
+void mm_free_sized(void *ptr, size_t size) {
+  if (!ptr)
+    return;
+
+  free_block(bt_fromptr(ptr), blksz(size));
+}
+#endif /* MM_EXTENSIONS */
+
 /* --=[ mm_checkheap ]=----------------------------------------------------- */
 
 void mm_checkheap(int verbose) { /* verbose=0: check only; verbose=1: print and
@@ -20,6 +20,11 @@ extern void *calloc(size_t nmemb, size_t size);
 
 extern int mm_init(void);
 
+/* Only in builds with MM_EXTENSIONS, see mm.so. mm_free_sized takes the size
+   passed to malloc, calloc or mm_aligned_alloc; not for realloced blocks. */
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern void mm_free_sized(void *ptr, size_t size);
+
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);
@@ -0,0 +1,174 @@
+/*
+ * newbench.cc - allocation-heavy C++ workloads on the global operator new.
+ *
+ * Usage: [LD_PRELOAD=./mm.so] newbench [-h] [-n <objs>] [-r <rounds>]
+ *
+ * Run it with and without mm.so to compare mm.c with the allocator of the C
+ * library. The workloads:
+ *
+ *   list      push and pop objects on a std::list
+ *   tree      build and destroy a binary tree of unique_ptr nodes
+ *   map       insert strings into a std::map, then erase them at random
+ *   shared    make_shared objects, drop them in random order
+ *   aligned   new and delete of objects aligned to 64 bytes
+ *
+ * It reports nanoseconds per object allocated and freed, best of <rounds>.
+ * Before that it checks that new of more than the heap can hold throws.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+static long nobjs = 100000; /* objects per workload */
+static int rounds = 5;
+
+static std::vector<int> order;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_list() {
+  std::list<long> l;
+  for (long i = 0; i < nobjs; i++)
+    l.push_back(i);
+  while (!l.empty())
+    l.pop_front();
+}
+
+struct node {
+  std::unique_ptr<node> left, right;
+};
+
+static std::unique_ptr<node> build(long n) {
+  if (n == 0)
+    return nullptr;
+  auto t = std::make_unique<node>();
+  t->left = build((n - 1) / 2);
+  t->right = build(n - 1 - (n - 1) / 2);
+  return t;
+}
+
+static void bench_tree() {
+  build(nobjs);
+}
+
+static void bench_map() {
+  std::map<std::string, long> m;
+  std::vector<std::string> keys;
+  keys.reserve(nobjs);
+  for (long i = 0; i < nobjs; i++) {
+    keys.push_back("key-of-some-length-" + std::to_string(i));
+    m.emplace(keys.back(), i);
+  }
+  for (long i = 0; i < nobjs; i++)
+    m.erase(keys[order[i]]);
+}
+
+static void bench_shared() {
+  std::vector<std::shared_ptr<std::vector<int>>> v;
+  v.reserve(nobjs);
+  for (long i = 0; i < nobjs; i++)
+    v.push_back(std::make_shared<std::vector<int>>(i % 32));
+  for (long i = 0; i < nobjs; i++)
+    v[order[i]].reset();
+}
+
+struct alignas(64) line {
+  char bytes[64];
+};
+
+static void bench_aligned() {
+  std::vector<line *> v(nobjs);
+  for (long i = 0; i < nobjs; i++)
+    v[i] = new line;
+  for (long i = 0; i < nobjs; i++)
+    delete v[order[i]];
+}
+
+/* Allocations larger than the heap must throw bad_alloc, not crash. */
+static void check_oversized() {
+  const std::size_t sizes[] = {std::size_t(200) << 20, SIZE_MAX / 2};
+  for (std::size_t size : sizes) {
+    try {
+      std::vector<char> v(size);
+      if (size == SIZE_MAX / 2) {
+        fprintf(stderr, "newbench: new of %zu bytes did not throw\n", size);
+        exit(EXIT_FAILURE);
+      }
+    } catch (const std::bad_alloc &) {
+    }
+  }
+}
+
+static const struct {
+  const char *name;
+  void (*run)();
+} benches[] = {
+  {"list", bench_list},     {"tree", bench_tree},       {"map", bench_map},
+  {"shared", bench_shared}, {"aligned", bench_aligned},
+};
+
+static void usage() {
+  fprintf(stderr, "Usage: newbench [-h] [-n <objs>] [-r <rounds>]\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "\t-n <i>     Allocate <i> objects per workload.\n");
+  fprintf(stderr, "\t-r <i>     Run <i> rounds.\n");
+}
+
+int main(int argc, char **argv) {
+  int c;
+  while ((c = getopt(argc, argv, "hn:r:")) != EOF) {
+    switch (c) {
+      case 'n':
+        nobjs = atol(optarg);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      case 'h':
+        usage();
+        exit(EXIT_SUCCESS);
+      default:
+        usage();
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (nobjs < 1 || rounds < 1) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+
+  check_oversized();
+
+  for (long i = 0; i < nobjs; i++)
+    order.push_back(i);
+  std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+  printf("%-10s %10s\n", "workload", "ns/obj");
+  for (const auto &b : benches) {
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+      double start = now();
+      b.run();
+      double t = now() - start;
+      if (r == 0 || t < best)
+        best = t;
+    }
+    printf("%-10s %10.1f\n", b.name, best * 1e9 / nobjs);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/*
+ * newdelete.cc - operator new and delete of mm.so.
+ *
+ * All replaceable forms are here: plain, array, nothrow, aligned and sized.
+ * Aligned forms get blocks of the exact size from mm_aligned_alloc instead of
+ * over-allocating. new never hands a block to realloc, so the sized forms of
+ * delete pass the size on to mm_free_sized, which need not decode it from the
+ * boundary tag.
+ */
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "preload.h"
+
+static void *allocate(std::size_t size, std::size_t align) {
+  for (;;) {
+    void *p = align > alignof(std::max_align_t)
+                ? std::aligned_alloc(align, size)
+                : std::malloc(size);
+    if (p)
+      return p;
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+static void *allocate_nothrow(std::size_t size, std::size_t align) noexcept {
+  try {
+    return allocate(size, align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void *operator new(std::size_t size) {
+  return allocate(size, 0);
+}
+
+void *operator new[](std::size_t size) {
+  return allocate(size, 0);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t align) {
+  return allocate(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return allocate(size, static_cast<std::size_t>(align));
+}
+
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+  return allocate_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size) noexcept {
+  preload_free_sized(ptr, size);
+}
+
+void operator delete[](void *ptr, std::size_t size) noexcept {
+  preload_free_sized(ptr, size);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t size, std::align_val_t) noexcept {
+  preload_free_sized(ptr, size);
+}
+
+void operator delete[](void *ptr, std::size_t size, std::align_val_t) noexcept {
+  preload_free_sized(ptr, size);
+}
@@ -0,0 +1,125 @@
+/*
+ * perfctr.c - read hardware performance counters with perf_event_open.
+ *
+ * Many machines, and most virtual machines, don't have all of the events.
+ * Those that can't be opened are left out, and with none at all the caller
+ * is expected to say so and carry on.
+ */
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "perfctr.h"
+
+#define CACHE(cache, result)                                                   \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | ((result) << 16))
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} events[PERFCTR_NUM] = {
+  [PERFCTR_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  [PERFCTR_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  [PERFCTR_L1D_MISSES] = {PERF_TYPE_HW_CACHE,
+                          CACHE(PERF_COUNT_HW_CACHE_L1D,
+                                PERF_COUNT_HW_CACHE_RESULT_MISS)},
+  [PERFCTR_LLC_MISSES] = {PERF_TYPE_HW_CACHE,
+                          CACHE(PERF_COUNT_HW_CACHE_LL,
+                                PERF_COUNT_HW_CACHE_RESULT_MISS)},
+  [PERFCTR_BRANCH_MISSES] = {PERF_TYPE_HARDWARE,
+                             PERF_COUNT_HW_BRANCH_MISSES},
+  [PERFCTR_DTLB_MISSES] = {PERF_TYPE_HW_CACHE,
+                           CACHE(PERF_COUNT_HW_CACHE_DTLB,
+                                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+  [PERFCTR_PAGE_FAULTS] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+const char *const perfctr_names[PERFCTR_NUM] = {
+  "instructions", "cycles",      "L1d-misses",  "LLC-misses",
+  "branch-misses", "dTLB-misses", "page-faults",
+};
+
+/* Open the first n events as one group and enable it. */
+static int open_group(perfctr_t *pc, int n) {
+  memset(pc, 0, sizeof(*pc));
+  pc->leader = -1;
+
+  for (int e = 0; e < PERFCTR_NUM; e++) {
+    struct perf_event_attr attr;
+
+    pc->fd[e] = -1;
+    if (e >= n)
+      continue;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.disabled = pc->leader < 0;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    pc->fd[e] = syscall(SYS_perf_event_open, &attr, 0, -1, pc->leader, 0);
+    if (pc->fd[e] < 0) {
+      if (!pc->error)
+        pc->error = errno;
+      continue;
+    }
+    if (pc->leader < 0)
+      pc->leader = pc->fd[e];
+    pc->mask |= 1u << e;
+    pc->nopen++;
+  }
+
+  if (pc->nopen > 0)
+    ioctl(pc->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return pc->nopen;
+}
+
+/*
+ * The kernel schedules a group all or nothing. If the PMU has too few
+ * counters free for it, say because the NMI watchdog holds one, the group
+ * never runs and every event reads 0. Then drop the last event and retry.
+ */
+int perfctr_open(perfctr_t *pc) {
+  uint64_t v[PERFCTR_NUM];
+  int n = PERFCTR_NUM, busy = 0;
+
+  while (open_group(pc, n) > 0) {
+    if (perfctr_read(pc, v) > 0)
+      return pc->nopen;
+    n = 31 - __builtin_clz(pc->mask); /* the last event that opened */
+    perfctr_close(pc);
+    busy = 1;
+  }
+  if (busy)
+    pc->error = EBUSY;
+  return 0;
+}
+
+void perfctr_close(perfctr_t *pc) {
+  for (int e = 0; e < PERFCTR_NUM; e++)
+    if (pc->mask & (1u << e))
+      close(pc->fd[e]);
+  pc->mask = 0;
+  pc->nopen = 0;
+}
+
+double perfctr_read(const perfctr_t *pc, uint64_t v[PERFCTR_NUM]) {
+  /* nr, time enabled, time running, then the values in order of opening */
+  uint64_t buf[3 + PERFCTR_NUM];
+  int i = 3;
+
+  memset(v, 0, PERFCTR_NUM * sizeof(uint64_t));
+  if (pc->nopen == 0 || read(pc->leader, buf, sizeof(buf)) < 0)
+    return 0;
+
+  for (int e = 0; e < PERFCTR_NUM; e++)
+    if (pc->mask & (1u << e))
+      v[e] = buf[i++];
+  return buf[1] ? (double)buf[2] / buf[1] : 1;
+}
@@ -0,0 +1,43 @@
+#include <stdint.h>
+
+/*
+ * Hardware performance counters of the calling thread, read with
+ * perf_event_open. All events that the machine supports are opened as one
+ * group, so that they count over the same instructions and are read with a
+ * single system call. If the PMU can't count the whole group at once, the
+ * last events are left out. User space only: the kernel is excluded.
+ */
+enum {
+  PERFCTR_INSTRUCTIONS,
+  PERFCTR_CYCLES,
+  PERFCTR_L1D_MISSES,
+  PERFCTR_LLC_MISSES,
+  PERFCTR_BRANCH_MISSES,
+  PERFCTR_DTLB_MISSES,
+  PERFCTR_PAGE_FAULTS,
+  PERFCTR_NUM
+};
+
+/* names of the events, indexed as above */
+extern const char *const perfctr_names[PERFCTR_NUM];
+
+typedef struct {
+  int fd[PERFCTR_NUM]; /* -1 if the event is not available */
+  int leader;          /* fd of the group leader */
+  int nopen;           /* number of events opened */
+  unsigned mask;       /* bit e is set if event e was opened */
+  int error;           /* errno of the first event that failed */
+} perfctr_t;
+
+/*
+ * Open the counters; returns the number of events opened, 0 if none. The
+ * error is EBUSY if events opened but none of them could be scheduled.
+ */
+extern int perfctr_open(perfctr_t *pc);
+extern void perfctr_close(perfctr_t *pc);
+/*
+ * Store the current value of every event in v (0 for those not opened) and
+ * return the fraction of the time the group was counting; it is below 1
+ * when the kernel had to multiplex the counters with other groups.
+ */
+extern double perfctr_read(const perfctr_t *pc, uint64_t v[PERFCTR_NUM]);
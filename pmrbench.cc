@@ -0,0 +1,191 @@
+/*
+ * pmrbench.cc - standard containers on mm_resource and mm_allocator.
+ *
+ * Usage: pmrbench [-h] [-n <elems>] [-r <rounds>]
+ *
+ * Every workload runs three times: with pmr containers on the default
+ * resource (new and delete of the C++ runtime), with pmr containers on
+ * mm_resource, and with std containers on mm_allocator. The mm runs start on
+ * a fresh heap. The workloads:
+ *
+ *   vector         fill short vectors of ints with push_back
+ *   map            insert random keys, then erase them in another order
+ *   unordered_map  the same on a hash map
+ *   string         build strings of 16..128 characters, then double them
+ *
+ * It reports nanoseconds per container operation, best of <rounds>, the heap
+ * size mm_resource needed and the speedup of mm_resource over the default
+ * resource.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include "resource.h"
+
+#define VECTOR_LEN 100 /* elements of each short vector */
+
+static long nelems = 100000; /* elements per workload */
+static int rounds = 5;
+
+static std::vector<int> keys, order, lengths;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void fresh_heap() {
+  mem_reset_brk();
+  if (mm_init() < 0) {
+    fprintf(stderr, "mm_init failed\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* Containers whose allocator is A<T>. pmr containers pick the resource up
+   from std::pmr::get_default_resource. */
+template <template <class> class A> struct containers {
+  using vector = std::vector<int, A<int>>;
+  using map = std::map<int, int, std::less<int>, A<std::pair<const int, int>>>;
+  using unordered_map =
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                       A<std::pair<const int, int>>>;
+  using string = std::basic_string<char, std::char_traits<char>, A<char>>;
+  using strings = std::vector<string, A<string>>;
+};
+
+/* Each workload returns the number of container operations it did. */
+template <class C> static long bench_vector() {
+  long ops = 0;
+  for (long i = 0; i < nelems / VECTOR_LEN; i++) {
+    typename C::vector v;
+    for (int j = 0; j < VECTOR_LEN; j++)
+      v.push_back(j);
+    ops += VECTOR_LEN;
+  }
+  return ops;
+}
+
+template <class M> static long bench_map() {
+  M m;
+  for (long i = 0; i < nelems; i++)
+    m.emplace(keys[i], i);
+  for (long i = 0; i < nelems; i++)
+    m.erase(keys[order[i]]);
+  return 2 * nelems;
+}
+
+template <class C> static long bench_string() {
+  typename C::strings v;
+  v.reserve(nelems);
+  for (long i = 0; i < nelems; i++)
+    v.emplace_back(lengths[i], 'x');
+  for (long i = 0; i < nelems; i++)
+    v[order[i]] += v[i];
+  return 2 * nelems;
+}
+
+template <class C> struct workloads {
+  static constexpr long (*run[])() = {
+    bench_vector<C>,
+    bench_map<typename C::map>,
+    bench_map<typename C::unordered_map>,
+    bench_string<C>,
+  };
+};
+
+static const char *const names[] = {"vector", "map", "unordered_map",
+                                    "string"};
+
+/* Best time per operation of f over all rounds, on a fresh heap if mm. */
+static double measure(long (*f)(), bool mm) {
+  double best = 0;
+  for (int r = 0; r < rounds; r++) {
+    if (mm)
+      fresh_heap();
+    double start = now();
+    long ops = f();
+    double t = (now() - start) * 1e9 / ops;
+    if (r == 0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+static void usage() {
+  fprintf(stderr, "Usage: pmrbench [-h] [-n <elems>] [-r <rounds>]\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "\t-n <i>     Put <i> elements in the containers.\n");
+  fprintf(stderr, "\t-r <i>     Run <i> rounds.\n");
+}
+
+int main(int argc, char **argv) {
+  int c;
+  while ((c = getopt(argc, argv, "hn:r:")) != EOF) {
+    switch (c) {
+      case 'n':
+        nelems = atol(optarg);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      case 'h':
+        usage();
+        exit(EXIT_SUCCESS);
+      default:
+        usage();
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (nelems < VECTOR_LEN || rounds < 1) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+
+  std::mt19937 rng(1);
+  for (long i = 0; i < nelems; i++) {
+    keys.push_back(rng());
+    order.push_back(i);
+    lengths.push_back(16 + rng() % 113);
+  }
+  std::shuffle(order.begin(), order.end(), rng);
+
+  mem_init();
+
+  using pmr = workloads<containers<std::pmr::polymorphic_allocator>>;
+  using mm = workloads<containers<mm_allocator>>;
+  printf("%-14s %12s %12s %10s %12s %10s\n", "workload", "new ns/op",
+         "pmr mm ns/op", "pmr heap", "alloc ns/op", "speedup");
+  try {
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+      std::pmr::set_default_resource(std::pmr::new_delete_resource());
+      double base = measure(pmr::run[i], false);
+      std::pmr::set_default_resource(mm_get_resource());
+      double pmr_mm = measure(pmr::run[i], true);
+      size_t heap = mem_heapsize();
+      std::pmr::set_default_resource(nullptr);
+      double alloc_mm = measure(mm::run[i], true);
+      printf("%-14s %12.1f %12.1f %10zu %12.1f %9.2fx\n", names[i], base,
+             pmr_mm, heap, alloc_mm, base / pmr_mm);
+    }
+  } catch (const std::bad_alloc &) {
+    fprintf(stderr, "pmrbench: out of heap, try a smaller -n\n");
+    exit(EXIT_FAILURE);
+  }
+
+  mem_deinit();
+  return EXIT_SUCCESS;
+}
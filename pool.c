@@ -0,0 +1,217 @@
+/*
+ * pool.c - fixed-size object pools.
+ *
+ * Every slab starts with a header holding its own free list, the number of
+ * live objects and links of the list of partial slabs, i.e. slabs with at
+ * least one free object. Objects never handed out yet are taken with a bump
+ * pointer, so a new slab is not threaded onto a free list up front.
+ *
+ * To find the slab of a freed object the pool keeps an array of slabs sorted
+ * by address and searches it with bisection. When a slab becomes empty it is
+ * returned to the main heap, unless it is the only partial slab left, which
+ * avoids thrashing when the pool oscillates around a slab boundary.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "pool.h"
+
+#ifndef DRIVER
+#define mm_malloc malloc
+#define mm_free free
+#define mm_realloc realloc
+#endif
+
+#define ALIGN(x, a) (((x) + (a)-1) & -(a))
+
+#define SLAB_MIN 4096   /* minimum slab size in bytes */
+#define SLAB_OBJS 32    /* minimum number of objects in a slab */
+#define TABLE_INIT 16   /* initial capacity of the slab table */
+
+typedef struct slab {
+  struct slab *next; /* next partial slab */
+  struct slab *prev; /* previous partial slab */
+  void *free;        /* first free object */
+  char *bump;        /* first object never handed out */
+  char *end;         /* end of the last object */
+  size_t live;       /* number of allocated objects */
+} slab_t;
+
+struct mm_pool {
+  size_t objsize;  /* object size, multiple of align */
+  size_t align;    /* object alignment */
+  size_t slabsz;   /* bytes requested from mm_malloc for a slab */
+  size_t nobjs;    /* objects per slab */
+  slab_t *partial; /* slabs with free objects */
+  slab_t **slabs;  /* all slabs sorted by address */
+  size_t nslabs;
+  size_t capacity; /* of the slabs array */
+};
+
+/* --=[ slab table ]=------------------------------------------------------- */
+
+/* Returns position of the last slab starting at or below ptr. */
+static size_t table_find(mm_pool_t *pool, void *ptr) {
+  size_t lo = 0, hi = pool->nslabs;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if ((void *)pool->slabs[mid] <= ptr)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static int table_insert(mm_pool_t *pool, slab_t *s) {
+  if (pool->nslabs == pool->capacity) {
+    size_t capacity = pool->capacity * 2;
+    slab_t **slabs = mm_realloc(pool->slabs, capacity * sizeof(slab_t *));
+    if (!slabs)
+      return 0;
+    pool->slabs = slabs;
+    pool->capacity = capacity;
+  }
+  size_t i = pool->nslabs;
+  if (i > 0) {
+    i = table_find(pool, s);
+    if (pool->slabs[i] < s)
+      i++;
+  }
+  memmove(&pool->slabs[i + 1], &pool->slabs[i],
+          (pool->nslabs - i) * sizeof(slab_t *));
+  pool->slabs[i] = s;
+  pool->nslabs++;
+  return 1;
+}
+
+static void table_remove(mm_pool_t *pool, slab_t *s) {
+  size_t i = table_find(pool, s);
+  memmove(&pool->slabs[i], &pool->slabs[i + 1],
+          (pool->nslabs - i - 1) * sizeof(slab_t *));
+  pool->nslabs--;
+}
+
+/* --=[ partial slab list ]=------------------------------------------------ */
+
+static inline void partial_add(mm_pool_t *pool, slab_t *s) {
+  s->prev = NULL;
+  s->next = pool->partial;
+  if (pool->partial)
+    pool->partial->prev = s;
+  pool->partial = s;
+}
+
+static inline void partial_remove(mm_pool_t *pool, slab_t *s) {
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    pool->partial = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+}
+
+/* --=[ slabs ]=------------------------------------------------------------ */
+
+static slab_t *slab_new(mm_pool_t *pool) {
+  slab_t *s = mm_malloc(pool->slabsz);
+  if (!s)
+    return NULL;
+  if (!table_insert(pool, s)) {
+    mm_free(s);
+    return NULL;
+  }
+  s->free = NULL;
+  s->bump = (char *)ALIGN((uintptr_t)(s + 1), pool->align);
+  s->end = s->bump + pool->nobjs * pool->objsize;
+  s->live = 0;
+  partial_add(pool, s);
+  return s;
+}
+
+static void slab_release(mm_pool_t *pool, slab_t *s) {
+  partial_remove(pool, s);
+  table_remove(pool, s);
+  mm_free(s);
+}
+
+/* --=[ pool ]-------------------------------------------------------------- */
+
+mm_pool_t *mm_pool_create(size_t objsize, size_t align) {
+  if (align < sizeof(void *))
+    align = sizeof(void *);
+  if (align & (align - 1))
+    return NULL;
+  if (objsize < sizeof(void *))
+    objsize = sizeof(void *);
+  objsize = ALIGN(objsize, align);
+
+  mm_pool_t *pool = mm_malloc(sizeof(mm_pool_t));
+  if (!pool)
+    return NULL;
+
+  /* slab header and padding needed to align the first object */
+  size_t overhead = sizeof(slab_t);
+  if (align > ALIGNMENT)
+    overhead += align - ALIGNMENT;
+  overhead = ALIGN(overhead, align < ALIGNMENT ? align : ALIGNMENT);
+
+  size_t slabsz = overhead + SLAB_OBJS * objsize;
+  if (slabsz < SLAB_MIN)
+    slabsz = SLAB_MIN;
+
+  pool->objsize = objsize;
+  pool->align = align;
+  pool->slabsz = slabsz;
+  pool->nobjs = (slabsz - overhead) / objsize;
+  pool->partial = NULL;
+  pool->nslabs = 0;
+  pool->capacity = TABLE_INIT;
+  pool->slabs = mm_malloc(TABLE_INIT * sizeof(slab_t *));
+  if (!pool->slabs) {
+    mm_free(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+void *mm_pool_alloc(mm_pool_t *pool) {
+  slab_t *s = pool->partial;
+  if (!s && !(s = slab_new(pool)))
+    return NULL;
+
+  void *obj = s->free;
+  if (obj) {
+    s->free = *(void **)obj;
+  } else {
+    obj = s->bump;
+    s->bump += pool->objsize;
+  }
+  if (++s->live == pool->nobjs)
+    partial_remove(pool, s);
+  return obj;
+}
+
+void mm_pool_free(mm_pool_t *pool, void *ptr) {
+  if (!ptr)
+    return;
+
+  slab_t *s = pool->slabs[table_find(pool, ptr)];
+  if (s->live == pool->nobjs)
+    partial_add(pool, s);
+  *(void **)ptr = s->free;
+  s->free = ptr;
+
+  /* Keep the last partial slab around, release other empty ones. */
+  if (--s->live == 0 && (s->prev || s->next))
+    slab_release(pool, s);
+}
+
+void mm_pool_destroy(mm_pool_t *pool) {
+  for (size_t i = 0; i < pool->nslabs; i++)
+    mm_free(pool->slabs[i]);
+  mm_free(pool->slabs);
+  mm_free(pool);
+}
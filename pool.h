@@ -0,0 +1,16 @@
+#include <stddef.h>
+
+/*
+ * Pools of fixed-size objects. Objects are carved out of large slabs obtained
+ * from the main heap with mm_malloc and carry no boundary tags; free objects
+ * are linked through their first word. A slab whose objects are all free is
+ * handed back to the main heap.
+ */
+typedef struct mm_pool mm_pool_t;
+
+/* Create a pool of objects of objsize bytes aligned to align (power of 2). */
+extern mm_pool_t *mm_pool_create(size_t objsize, size_t align);
+extern void *mm_pool_alloc(mm_pool_t *pool);
+extern void mm_pool_free(mm_pool_t *pool, void *ptr);
+/* Free all objects, slabs and the pool itself. */
+extern void mm_pool_destroy(mm_pool_t *pool);
@@ -0,0 +1,145 @@
+/*
+ * poolbench.c - compare fixed-size pools with plain mm_malloc/mm_free.
+ *
+ * For every object size the benchmark allocates a batch of objects and frees
+ * them in random order, a few rounds in a row, first with mm_pool_alloc and
+ * mm_pool_free, then with mm_malloc and mm_free on a fresh heap. It reports
+ * nanoseconds per operation and the heap size after the run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "pool.h"
+
+static const size_t sizes[] = {16, 24, 32, 48, 64, 96, 128, 256};
+
+static int nobjs = 100000; /* objects allocated in every round */
+static int rounds = 10;    /* number of allocate-all/free-all rounds */
+
+static void **objs; /* live objects */
+static int *order;  /* random order of frees */
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void fresh_heap(void) {
+  mem_reset_brk();
+  if (mm_init() < 0) {
+    fprintf(stderr, "mm_init failed\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void shuffle(void) {
+  for (int i = nobjs - 1; i > 0; i--) {
+    int j = random() % (i + 1);
+    int t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+}
+
+static double bench_pool(size_t size) {
+  fresh_heap();
+  mm_pool_t *pool = mm_pool_create(size, ALIGNMENT);
+  if (!pool) {
+    fprintf(stderr, "mm_pool_create failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  double start = now();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < nobjs; i++)
+      if (!(objs[i] = mm_pool_alloc(pool))) {
+        fprintf(stderr, "mm_pool_alloc failed\n");
+        exit(EXIT_FAILURE);
+      }
+    for (int i = 0; i < nobjs; i++)
+      mm_pool_free(pool, objs[order[i]]);
+  }
+  double secs = now() - start;
+
+  mm_pool_destroy(pool);
+  return secs;
+}
+
+static double bench_malloc(size_t size) {
+  fresh_heap();
+
+  double start = now();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < nobjs; i++)
+      if (!(objs[i] = mm_malloc(size))) {
+        fprintf(stderr, "mm_malloc failed\n");
+        exit(EXIT_FAILURE);
+      }
+    for (int i = 0; i < nobjs; i++)
+      mm_free(objs[order[i]]);
+  }
+  return now() - start;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: poolbench [-h] [-n <objs>] [-r <rounds>]\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "\t-n <i>     Allocate <i> objects per round.\n");
+  fprintf(stderr, "\t-r <i>     Run <i> rounds.\n");
+}
+
+int main(int argc, char **argv) {
+  int c;
+  while ((c = getopt(argc, argv, "hn:r:")) != EOF) {
+    switch (c) {
+      case 'n':
+        nobjs = atoi(optarg);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      case 'h':
+        usage();
+        exit(EXIT_SUCCESS);
+      default:
+        usage();
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  objs = malloc(nobjs * sizeof(void *));
+  order = malloc(nobjs * sizeof(int));
+  if (!objs || !order) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < nobjs; i++)
+    order[i] = i;
+
+  mem_init();
+
+  double ops = 2.0 * nobjs * rounds;
+  printf("%6s %12s %10s %12s %10s\n", "size", "pool ns/op", "pool heap",
+         "malloc ns/op", "malloc heap");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    shuffle();
+    double pool_secs = bench_pool(sizes[i]);
+    size_t pool_heap = mem_heapsize();
+    double malloc_secs = bench_malloc(sizes[i]);
+    size_t malloc_heap = mem_heapsize();
+    printf("%6zu %12.1f %10zu %12.1f %10zu\n", sizes[i], pool_secs * 1e9 / ops,
+           pool_heap, malloc_secs * 1e9 / ops, malloc_heap);
+  }
+
+  mem_deinit();
+  free(objs);
+  free(order);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/*
+ * preload.c - run any program on mm.c.
+ *
+ *   LD_PRELOAD=./mm.so <program> <args...>
+ *
+ * malloc, free, realloc, calloc and the memalign family are served from the
+ * simulated heap of memlib, which is set up on the first request. mm.c is not
+ * thread-safe, so every request holds one global lock. Pointers that are not
+ * in the heap, such as those the dynamic linker hands out before the program
+ * starts, are ignored by free. The heap can't grow past MAX_HEAP; requests
+ * beyond it fail with ENOMEM and without a message.
+ *
+ * operator new and delete are in newdelete.cc; they call aligned_alloc, which
+ * maps onto mm_aligned_alloc, and preload_free_sized for sized delete.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+#include "preload.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int ready; /* are memlib and mm.c initialized? */
+
+static void acquire(void) {
+  pthread_mutex_lock(&lock);
+  if (!ready) {
+    mem_init();
+    if (mm_init() < 0)
+      abort();
+    ready = 1;
+  }
+}
+
+static void release(void) {
+  pthread_mutex_unlock(&lock);
+}
+
+static inline int in_heap(void *ptr) {
+  return ready && ptr >= mem_heap_lo() && ptr <= mem_heap_hi();
+}
+
+/* a forked child must not find the lock taken by another thread */
+__attribute__((constructor)) static void preload_init(void) {
+  pthread_atfork(acquire, release, release);
+}
+
+void *malloc(size_t size) {
+  acquire();
+  void *p = mm_malloc(size);
+  release();
+  if (!p)
+    errno = ENOMEM;
+  return p;
+}
+
+void free(void *ptr) {
+  if (!ptr)
+    return;
+
+  acquire();
+  if (in_heap(ptr))
+    mm_free(ptr);
+  release();
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  size_t total;
+
+  if (__builtin_mul_overflow(nmemb, size, &total)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  acquire();
+  void *p = mm_calloc(1, total);
+  release();
+  if (!p)
+    errno = ENOMEM;
+  return p;
+}
+
+void *realloc(void *ptr, size_t size) {
+  acquire();
+  void *p = NULL;
+  if (!ptr || in_heap(ptr))
+    p = mm_realloc(ptr, size);
+  release();
+  if (!p && size)
+    errno = ENOMEM;
+  return p;
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+  size_t total;
+
+  if (__builtin_mul_overflow(nmemb, size, &total)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return realloc(ptr, total);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  acquire();
+  void *p = mm_aligned_alloc(alignment, size);
+  release();
+  if (!p)
+    errno = alignment & (alignment - 1) ? EINVAL : ENOMEM;
+  return p;
+}
+
+void *memalign(size_t alignment, size_t size) {
+  return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size) {
+  return aligned_alloc(getpagesize(), size);
+}
+
+void *pvalloc(size_t size) {
+  size_t pagesize = getpagesize();
+  return aligned_alloc(pagesize, (size + pagesize - 1) & -pagesize);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+    return EINVAL;
+
+  void *p = aligned_alloc(alignment, size);
+  if (!p)
+    return ENOMEM;
+  *memptr = p;
+  return 0;
+}
+
+void preload_free_sized(void *ptr, size_t size) {
+  if (!ptr)
+    return;
+
+  acquire();
+  if (in_heap(ptr))
+    mm_free_sized(ptr, size);
+  release();
+}
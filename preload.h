@@ -0,0 +1,16 @@
+#include <stddef.h>
+
+/*
+ * Entry points of mm.so for operator new and delete besides the ones of
+ * libc. preload_free_sized takes the size that was passed to malloc,
+ * calloc or aligned_alloc; blocks that were passed to realloc need free.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void preload_free_sized(void *ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,287 @@
+/*
+ * rec2bin.c - turn the records written by recorder.so into a binary trace.
+ *
+ * Usage: rec2bin <input.rec> <output.bin>
+ *
+ * Records are sorted by sequence number and replayed against a map from
+ * block addresses to ids. Every allocation gets a new id, which realloc
+ * keeps. Threads are numbered in order of their first request. Frees and
+ * reallocs of blocks allocated before the recorder started are dropped (such
+ * a realloc becomes a malloc). An allocation that returns a block which is
+ * still live raced with the free of that block in another thread; it is held
+ * back until that free.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "recorder.h"
+#include "tracebin.h"
+
+/* open addressing map from block addresses to ids */
+typedef struct {
+  uint64_t *keys; /* 0 marks an empty slot */
+  int *vals;
+  size_t mask;
+  size_t used;
+} addrmap_t;
+
+static addrmap_t live;
+
+static FILE *out;
+static const char *outname;
+static tracebin_hdr_t hdr = {.magic = TRACEBIN_MAGIC,
+                             .version = TRACEBIN_VERSION,
+                             .weight = 1,
+                             .flags = TRACEBIN_THREADS};
+
+static uint32_t *tids; /* kernel thread id of each thread number */
+static int ntids;
+
+static const record_t **pending; /* held back allocations */
+static int npending, maxpending;
+
+static uint64_t last_time; /* time of the previous request written */
+static long dropped;       /* requests on unknown blocks */
+static long delayed;       /* allocations held back */
+
+static void die(const char *msg, const char *name) {
+  fprintf(stderr, "rec2bin: %s %s\n", msg, name);
+  exit(EXIT_FAILURE);
+}
+
+static void *xcalloc(size_t n, size_t size) {
+  void *p = calloc(n, size);
+  if (!p)
+    die("out of memory", "");
+  return p;
+}
+
+static inline size_t hash(uint64_t key) {
+  return (key >> 4) * 0x9e3779b97f4a7c15ULL >> 20;
+}
+
+static void map_init(addrmap_t *m, size_t slots) {
+  m->keys = xcalloc(slots, sizeof(uint64_t));
+  m->vals = xcalloc(slots, sizeof(int));
+  m->mask = slots - 1;
+  m->used = 0;
+}
+
+static size_t map_slot(addrmap_t *m, uint64_t key) {
+  size_t i = hash(key) & m->mask;
+  while (m->keys[i] && m->keys[i] != key)
+    i = (i + 1) & m->mask;
+  return i;
+}
+
+static int map_get(addrmap_t *m, uint64_t key) {
+  size_t i = map_slot(m, key);
+  return m->keys[i] ? m->vals[i] : -1;
+}
+
+static void map_put(addrmap_t *m, uint64_t key, int val) {
+  if (2 * (m->used + 1) > m->mask) {
+    addrmap_t n;
+    map_init(&n, 2 * (m->mask + 1));
+    for (size_t i = 0; i <= m->mask; i++)
+      if (m->keys[i])
+        map_put(&n, m->keys[i], m->vals[i]);
+    free(m->keys);
+    free(m->vals);
+    *m = n;
+  }
+
+  size_t i = map_slot(m, key);
+  if (!m->keys[i])
+    m->used++;
+  m->keys[i] = key;
+  m->vals[i] = val;
+}
+
+/* Remove with backward shifting, so that lookups need no tombstones. */
+static void map_del(addrmap_t *m, uint64_t key) {
+  size_t i = map_slot(m, key);
+  if (!m->keys[i])
+    return;
+  m->used--;
+
+  for (size_t j = (i + 1) & m->mask; m->keys[j]; j = (j + 1) & m->mask) {
+    size_t home = hash(m->keys[j]) & m->mask;
+    /* move j into the hole at i unless its home lies in (i, j] */
+    if (((j - home) & m->mask) >= ((j - i) & m->mask)) {
+      m->keys[i] = m->keys[j];
+      m->vals[i] = m->vals[j];
+      i = j;
+    }
+  }
+  m->keys[i] = 0;
+}
+
+static int thread_of(uint32_t tid) {
+  for (int i = 0; i < ntids; i++)
+    if (tids[i] == tid)
+      return i;
+  if (!(tids = realloc(tids, (ntids + 1) * sizeof(uint32_t))))
+    die("out of memory", "");
+  tids[ntids] = tid;
+  return ntids++;
+}
+
+static void emit(const record_t *r, int type, int id, size_t size) {
+  tracebin_op_t op = {.type = type, .id = id, .region = -1, .size = size};
+
+  op.thread = thread_of(r->tid);
+  if (r->time > last_time) {
+    op.time = r->time - last_time;
+    last_time = r->time;
+  }
+  if (tracebin_write_op(out, &op, hdr.flags))
+    die("could not write", outname);
+  hdr.num_ops++;
+}
+
+static void replay(const record_t *r);
+
+/* Replay the allocations held back until the block at ptr was freed. */
+static void release(uint64_t ptr) {
+  for (int i = 0; i < npending; i++) {
+    const record_t *r = pending[i];
+    if (r->ptr != ptr)
+      continue;
+    memmove(&pending[i], &pending[i + 1], (--npending - i) * sizeof(r));
+    replay(r);
+    return;
+  }
+}
+
+static void hold(const record_t *r) {
+  if (npending == maxpending) {
+    maxpending = maxpending ? 2 * maxpending : 64;
+    if (!(pending = realloc(pending, maxpending * sizeof(*pending))))
+      die("out of memory", "");
+  }
+  pending[npending++] = r;
+  delayed++;
+}
+
+static void replay(const record_t *r) {
+  int id;
+
+  switch (r->type) {
+    case REC_MALLOC:
+      if (map_get(&live, r->ptr) >= 0) {
+        hold(r);
+        break;
+      }
+      map_put(&live, r->ptr, hdr.num_ids);
+      emit(r, TR_ALLOC, hdr.num_ids++, r->size);
+      break;
+
+    case REC_FREE:
+      if ((id = map_get(&live, r->ptr)) < 0) {
+        dropped++;
+        break;
+      }
+      map_del(&live, r->ptr);
+      emit(r, TR_FREE, id, 0);
+      release(r->ptr);
+      break;
+
+    case REC_REALLOC:
+      if ((id = map_get(&live, r->old)) < 0) {
+        record_t m = *r;
+        m.type = REC_MALLOC;
+        dropped++;
+        if (map_get(&live, r->ptr) >= 0) {
+          /* keep a copy, as if it was malloc */
+          record_t *copy = xcalloc(1, sizeof(record_t));
+          *copy = m;
+          hold(copy);
+        } else {
+          replay(&m);
+        }
+        break;
+      }
+      if (r->ptr != r->old && map_get(&live, r->ptr) >= 0) {
+        hold(r);
+        break;
+      }
+      map_del(&live, r->old);
+      map_put(&live, r->ptr, id);
+      emit(r, TR_REALLOC, id, r->size);
+      if (r->ptr != r->old)
+        release(r->old);
+      break;
+
+    default:
+      die("bogus record type in", "input");
+  }
+}
+
+static int cmp_seq(const void *a, const void *b) {
+  uint64_t x = ((const record_t *)a)->seq, y = ((const record_t *)b)->seq;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+  struct stat st;
+  int fd;
+
+  if (argc != 3) {
+    fprintf(stderr, "Usage: rec2bin <input.rec> <output.bin>\n");
+    exit(EXIT_FAILURE);
+  }
+  outname = argv[2];
+
+  if ((fd = open(argv[1], O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+    die("could not open", argv[1]);
+  if (st.st_size % sizeof(record_t))
+    die("truncated records in", argv[1]);
+
+  size_t nrecs = st.st_size / sizeof(record_t);
+  record_t *recs = NULL;
+  if (nrecs > 0) {
+    recs = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (recs == MAP_FAILED)
+      die("could not map", argv[1]);
+  }
+  close(fd);
+
+  /* threads append whole buffers, so the file is only sorted per thread */
+  qsort(recs, nrecs, sizeof(record_t), cmp_seq);
+
+  for (size_t i = 0; i < nrecs; i++)
+    if (recs[i].time)
+      hdr.flags |= TRACEBIN_TIME;
+
+  if (!(out = fopen(outname, "w")))
+    die("could not create", outname);
+  if (tracebin_write_header(out, &hdr))
+    die("could not write", outname);
+
+  map_init(&live, 1 << 16);
+  for (size_t i = 0; i < nrecs; i++)
+    replay(&recs[i]);
+
+  /* allocations still held back never saw their block freed */
+  while (npending > 0) {
+    const record_t *r = pending[0];
+    map_del(&live, r->ptr);
+    release(r->ptr);
+  }
+
+  if (fseek(out, 0, SEEK_SET) || tracebin_write_header(out, &hdr) ||
+      fclose(out))
+    die("could not write", outname);
+
+  fprintf(stderr,
+          "%lu requests, %u blocks, %d threads; %ld requests on unknown "
+          "blocks dropped, %ld allocations delayed\n",
+          (unsigned long)hdr.num_ops, hdr.num_ids, ntids, dropped, delayed);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/*
+ * recorder.c - record the heap requests of any program.
+ *
+ *   LD_PRELOAD=./recorder.so MM_RECORD=out.rec <program> <args...>
+ *   ./rec2bin out.rec out.bin
+ *
+ * malloc, free, realloc, calloc and the memalign family are passed on to the
+ * glibc implementation. Each request is stored in a buffer of the calling
+ * thread, together with a sequence number from a global counter. Full buffers
+ * are appended to the output file with a single write. Block ids are assigned
+ * later by rec2bin, so the counter is the only state shared between threads.
+ *
+ * MM_RECORD names the output file, "%p" in it is replaced by the process id
+ * (default mm-%p.rec). With MM_RECORD_TIME=1 every request is timestamped.
+ * A forked child stops recording, unless it runs exec. A program it runs
+ * records to a file of its own if the name has "%p"; otherwise it doesn't
+ * record, so that it doesn't overwrite the file of the first program.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "recorder.h"
+
+extern void *__libc_malloc(size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+#define RECBUF (1 << 14) /* records in a thread buffer */
+
+typedef struct {
+  int n;        /* number of buffered records */
+  uint32_t tid; /* kernel thread id */
+  record_t recs[RECBUF];
+} recbuf_t;
+
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+static int fd = -1;        /* output file, -1 if not recording */
+static int timed;          /* set by MM_RECORD_TIME */
+static uint64_t seq;       /* next sequence number */
+static uint64_t start_ns;  /* time the recorder started */
+static pthread_key_t key;  /* flushes the buffer when a thread exits */
+static TLS recbuf_t *tbuf; /* buffer of this thread */
+static TLS int busy;       /* set while recording a request */
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void flush(recbuf_t *b) {
+  const char *p = (const char *)b->recs;
+  size_t len = b->n * sizeof(record_t);
+
+  while (fd >= 0 && len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    p += n;
+    len -= n;
+  }
+  b->n = 0;
+}
+
+static void thread_exit(void *arg) {
+  recbuf_t *b = arg;
+  flush(b);
+  tbuf = NULL;
+  munmap(b, sizeof(recbuf_t));
+}
+
+static recbuf_t *get_buf(void) {
+  if (tbuf)
+    return tbuf;
+
+  /* mmap, not malloc, so that the buffer doesn't show in the trace */
+  recbuf_t *b = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (b == MAP_FAILED)
+    return NULL;
+  b->n = 0;
+  b->tid = syscall(SYS_gettid);
+  pthread_setspecific(key, b);
+  return tbuf = b;
+}
+
+static inline uint64_t next_seq(void) {
+  return __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED);
+}
+
+static void put(uint64_t s, int type, void *ptr, void *old, size_t size) {
+  recbuf_t *b = get_buf();
+  if (!b)
+    return;
+
+  record_t *r = &b->recs[b->n++];
+  r->seq = s;
+  r->time = timed ? now_ns() - start_ns : 0;
+  r->ptr = (uintptr_t)ptr;
+  r->old = (uintptr_t)old;
+  r->size = size;
+  r->tid = b->tid;
+  r->type = type;
+
+  if (b->n == RECBUF)
+    flush(b);
+}
+
+static void stop_child(void) {
+  if (tbuf)
+    tbuf->n = 0;
+  if (fd >= 0)
+    close(fd);
+  fd = -1;
+}
+
+__attribute__((constructor)) static void recorder_init(void) {
+  const char *name = getenv("MM_RECORD");
+  const char *t = getenv("MM_RECORD_TIME");
+  char path[4096];
+  char *pid;
+
+  snprintf(path, sizeof(path), "%s", name ? name : "mm-%p.rec");
+  pid = strstr(path, "%p");
+  /* set by the first recorder, so that the programs it runs see it */
+  if (!pid && getenv("MM_RECORD_ACTIVE"))
+    return;
+  busy = 1;
+  setenv("MM_RECORD_ACTIVE", "1", 1);
+  busy = 0;
+  if (pid) {
+    char rest[4096];
+    snprintf(rest, sizeof(rest), "%s", pid + 2);
+    snprintf(pid, sizeof(path) - (pid - path), "%d%s", getpid(), rest);
+  }
+
+  timed = t && atoi(t);
+  start_ns = now_ns();
+  if (pthread_key_create(&key, thread_exit))
+    return;
+  pthread_atfork(NULL, NULL, stop_child);
+
+  busy = 1;
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  busy = 0;
+  if (fd < 0)
+    fprintf(stderr, "recorder: could not open %s\n", path);
+}
+
+__attribute__((destructor)) static void recorder_fini(void) {
+  if (tbuf)
+    flush(tbuf);
+}
+
+void *malloc(size_t size) {
+  if (busy || fd < 0)
+    return __libc_malloc(size);
+
+  busy = 1;
+  void *p = __libc_malloc(size);
+  if (p)
+    put(next_seq(), REC_MALLOC, p, NULL, size);
+  busy = 0;
+  return p;
+}
+
+void free(void *ptr) {
+  if (busy || fd < 0 || !ptr) {
+    __libc_free(ptr);
+    return;
+  }
+
+  /* the number must be taken before the block can be handed out again */
+  busy = 1;
+  uint64_t s = next_seq();
+  __libc_free(ptr);
+  put(s, REC_FREE, ptr, NULL, 0);
+  busy = 0;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  size_t total;
+
+  if (busy || fd < 0 || __builtin_mul_overflow(nmemb, size, &total))
+    return __libc_calloc(nmemb, size);
+
+  busy = 1;
+  void *p = __libc_calloc(nmemb, size);
+  if (p)
+    put(next_seq(), REC_MALLOC, p, NULL, total);
+  busy = 0;
+  return p;
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (busy || fd < 0)
+    return __libc_realloc(ptr, size);
+  if (!ptr)
+    return malloc(size);
+
+  /*
+   * Numbered before the call, like free. The new block might have been
+   * freed by another thread that got a later number; rec2bin then delays
+   * the realloc until that free.
+   */
+  busy = 1;
+  uint64_t s = next_seq();
+  void *p = __libc_realloc(ptr, size);
+  if (size == 0)
+    put(s, REC_FREE, ptr, NULL, 0);
+  else if (p)
+    put(s, REC_REALLOC, p, ptr, size);
+  busy = 0;
+  return p;
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+  size_t total;
+
+  if (__builtin_mul_overflow(nmemb, size, &total)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return realloc(ptr, total);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  if (busy || fd < 0)
+    return __libc_memalign(alignment, size);
+
+  busy = 1;
+  void *p = __libc_memalign(alignment, size);
+  if (p)
+    put(next_seq(), REC_MALLOC, p, NULL, size);
+  busy = 0;
+  return p;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+void *valloc(size_t size) {
+  return memalign(getpagesize(), size);
+}
+
+void *pvalloc(size_t size) {
+  size_t pagesize = getpagesize();
+  return memalign(pagesize, (size + pagesize - 1) & -pagesize);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+    return EINVAL;
+
+  void *p = memalign(alignment, size);
+  if (!p)
+    return ENOMEM;
+  *memptr = p;
+  return 0;
+}
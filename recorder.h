@@ -0,0 +1,19 @@
+#include <stdint.h>
+
+/*
+ * Raw records written by recorder.so, converted to a trace by rec2bin.
+ * Every thread buffers its records and appends them to the output file in
+ * batches, so records of different threads are interleaved in the file and
+ * seq gives their order.
+ */
+enum { REC_MALLOC, REC_FREE, REC_REALLOC };
+
+typedef struct {
+  uint64_t seq;  /* global order of the requests */
+  uint64_t time; /* ns since the recorder started, 0 if not recorded */
+  uint64_t ptr;  /* block returned by malloc/realloc, or freed block */
+  uint64_t old;  /* block passed to realloc */
+  uint64_t size; /* requested size */
+  uint32_t tid;  /* kernel thread id */
+  uint32_t type; /* REC_* */
+} record_t;
@@ -0,0 +1,91 @@
+/*
+ * region.c - bump allocation of objects with common lifetime.
+ *
+ * A region is a list of chunks allocated with mm_malloc. The region header
+ * lives in front of the first chunk, which is kept on reset, so a region that
+ * is reset after every request usually costs no heap traffic at all. Requests
+ * larger than the chunk size get a dedicated chunk.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "region.h"
+
+#ifndef DRIVER
+#define mm_malloc malloc
+#define mm_free free
+#endif
+
+#define ALIGN(x) (((x) + ALIGNMENT - 1) & -ALIGNMENT)
+
+typedef struct chunk {
+  struct chunk *next; /* previously filled chunk */
+  size_t size;        /* usable bytes after the chunk header */
+} chunk_t;
+
+struct mm_region {
+  chunk_t *chunks; /* most recent chunk first, the first chunk is last */
+  char *cur;       /* bump pointer in chunks */
+  char *end;       /* end of the most recent chunk */
+  size_t chunksz;  /* default chunk size */
+  chunk_t first;   /* header of the chunk embedded in the region */
+};
+
+#define CHUNK_HDR ALIGN(sizeof(chunk_t))
+#define REGION_HDR ALIGN(sizeof(mm_region_t))
+
+static inline char *chunk_data(chunk_t *c) {
+  return (char *)c + CHUNK_HDR;
+}
+
+mm_region_t *mm_region_create(size_t chunksz) {
+  chunksz = ALIGN(chunksz);
+  mm_region_t *r = mm_malloc(REGION_HDR + chunksz);
+  if (!r)
+    return NULL;
+  r->first.next = NULL;
+  r->first.size = chunksz;
+  r->chunks = &r->first;
+  r->cur = (char *)r + REGION_HDR;
+  r->end = r->cur + chunksz;
+  r->chunksz = chunksz;
+  return r;
+}
+
+void *mm_region_alloc(mm_region_t *r, size_t size) {
+  size = ALIGN(size);
+  if (size <= (size_t)(r->end - r->cur)) {
+    void *ptr = r->cur;
+    r->cur += size;
+    return ptr;
+  }
+
+  size_t chunksz = size > r->chunksz ? size : r->chunksz;
+  chunk_t *c = mm_malloc(CHUNK_HDR + chunksz);
+  if (!c)
+    return NULL;
+  c->next = r->chunks;
+  c->size = chunksz;
+  r->chunks = c;
+  r->cur = chunk_data(c) + size;
+  r->end = chunk_data(c) + chunksz;
+  return chunk_data(c);
+}
+
+void mm_region_reset(mm_region_t *r) {
+  chunk_t *next;
+  for (chunk_t *c = r->chunks; c != &r->first; c = next) {
+    next = c->next;
+    mm_free(c);
+  }
+  r->chunks = &r->first;
+  r->cur = (char *)r + REGION_HDR;
+  r->end = r->cur + r->first.size;
+}
+
+void mm_region_destroy(mm_region_t *r) {
+  mm_region_reset(r);
+  mm_free(r);
+}
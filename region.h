@@ -0,0 +1,16 @@
+#include <stddef.h>
+
+/*
+ * Regions (arenas) for objects that die together. Objects are bump allocated
+ * inside chunks obtained from the main heap with mm_malloc. There is no way to
+ * free a single object; mm_region_reset releases all of them at once.
+ */
+typedef struct mm_region mm_region_t;
+
+/* Create a region that grabs chunks of (at least) chunksz bytes. */
+extern mm_region_t *mm_region_create(size_t chunksz);
+extern void *mm_region_alloc(mm_region_t *r, size_t size);
+/* Free all objects, every chunk except the first goes back to the heap. */
+extern void mm_region_reset(mm_region_t *r);
+/* Free all objects and the region itself. */
+extern void mm_region_destroy(mm_region_t *r);
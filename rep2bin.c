@@ -0,0 +1,91 @@
+/*
+ * rep2bin.c - convert a text trace (.rep) to the binary trace format.
+ *
+ * Usage: rep2bin <input.rep> <output.bin>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tracebin.h"
+
+static void die(const char *msg, const char *name) {
+  fprintf(stderr, "rep2bin: %s %s\n", msg, name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  FILE *in, *out;
+  tracebin_hdr_t hdr = {.magic = TRACEBIN_MAGIC, .version = TRACEBIN_VERSION};
+  int num_ops, ignore_ranges;
+
+  if (argc != 3) {
+    fprintf(stderr, "Usage: rep2bin <input.rep> <output.bin>\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (!(in = fopen(argv[1], "r")))
+    die("could not open", argv[1]);
+  if (!(out = fopen(argv[2], "w")))
+    die("could not create", argv[2]);
+
+  if (fscanf(in, "%u %u %d %d", &hdr.weight, &hdr.num_ids, &num_ops,
+             &ignore_ranges) != 4)
+    die("bad header in", argv[1]);
+  hdr.num_ops = num_ops;
+
+  /* num_regions is known only at the end, the header is rewritten then */
+  if (tracebin_write_header(out, &hdr))
+    die("could not write", argv[2]);
+
+  for (int i = 0; i < num_ops; i++) {
+    tracebin_op_t op = {.region = -1};
+    unsigned size = 0;
+    char type;
+    int n;
+
+    if (fscanf(in, " %c", &type) != 1)
+      die("too few requests in", argv[1]);
+
+    switch (type) {
+      case 'a':
+        op.type = TR_ALLOC;
+        n = fscanf(in, "%d %u", &op.id, &size) - 2;
+        break;
+      case 'r':
+        op.type = TR_REALLOC;
+        n = fscanf(in, "%d %u", &op.id, &size) - 2;
+        break;
+      case 'f':
+        op.type = TR_FREE;
+        n = fscanf(in, "%d", &op.id) - 1;
+        break;
+      case 'A':
+        op.type = TR_RALLOC;
+        n = fscanf(in, "%d %d %u", &op.region, &op.id, &size) - 3;
+        break;
+      case 'x':
+        op.type = TR_RESET;
+        n = fscanf(in, "%d", &op.id) - 1;
+        break;
+      default:
+        die("bogus request type in", argv[1]);
+    }
+    if (n)
+      die("malformed request in", argv[1]);
+
+    op.size = size;
+    if (op.type == TR_RALLOC && op.region >= (int)hdr.num_regions)
+      hdr.num_regions = op.region + 1;
+    if (op.type == TR_RESET && op.id >= (int)hdr.num_regions)
+      hdr.num_regions = op.id + 1;
+
+    if (tracebin_write_op(out, &op, hdr.flags))
+      die("could not write", argv[2]);
+  }
+
+  if (fseek(out, 0, SEEK_SET) || tracebin_write_header(out, &hdr) ||
+      fclose(out))
+    die("could not write", argv[2]);
+  fclose(in);
+  return EXIT_SUCCESS;
+}
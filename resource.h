@@ -0,0 +1,136 @@
+#ifndef MM_RESOURCE_H
+#define MM_RESOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+extern "C" {
+#include "memlib.h"
+#include "mm.h"
+}
+
+/*
+ * C++ access to the main heap without replacing the global allocator:
+ * mm_resource is a std::pmr::memory_resource for pmr containers, mm_allocator
+ * an allocator for the standard containers. Both hand out blocks from
+ * mm_malloc; the heap must be set up (mem_init and mm_init) before use.
+ *
+ * With MM_EXTENSIONS, stricter alignments than ALIGNMENT come from
+ * mm_aligned_alloc and deallocate passes the size on to mm_free_sized.
+ * Otherwise mm_free finds the size in the boundary tag, and a stricter
+ * alignment is met by over-allocating and keeping the pointer that mm_malloc
+ * returned in the word just below the block handed out.
+ */
+
+#ifndef DRIVER
+#define mm_malloc malloc
+#define mm_free free
+#define mm_aligned_alloc aligned_alloc
+#define mm_free_sized(p, n) free(p)
+#endif
+
+namespace mm_detail {
+
+#ifdef MM_EXTENSIONS
+inline void *allocate(std::size_t size, std::size_t align) {
+  void *p = align <= ALIGNMENT ? mm_malloc(size)
+                               : mm_aligned_alloc(align, size);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+inline void deallocate(void *p, std::size_t size, std::size_t /* align */) {
+  mm_free_sized(p, size);
+}
+#else
+inline void *allocate(std::size_t size, std::size_t align) {
+  if (align <= ALIGNMENT) {
+    void *p = mm_malloc(size);
+    if (!p)
+      throw std::bad_alloc();
+    return p;
+  }
+
+  if (size > std::numeric_limits<std::size_t>::max() - align)
+    throw std::bad_alloc();
+  void *raw = mm_malloc(size + align);
+  if (!raw)
+    throw std::bad_alloc();
+  /* at least ALIGNMENT bytes above raw, so there is room for it below */
+  auto p = (reinterpret_cast<std::uintptr_t>(raw) + align) & -align;
+  reinterpret_cast<void **>(p)[-1] = raw;
+  return reinterpret_cast<void *>(p);
+}
+
+inline void deallocate(void *p, std::size_t /* size */, std::size_t align) {
+  if (align <= ALIGNMENT)
+    mm_free(p);
+  else
+    mm_free(static_cast<void **>(p)[-1]);
+}
+#endif
+
+} // namespace mm_detail
+
+class mm_resource : public std::pmr::memory_resource {
+private:
+  void *do_allocate(std::size_t bytes, std::size_t align) override {
+    return mm_detail::allocate(bytes, align);
+  }
+
+  void do_deallocate(void *p, std::size_t bytes, std::size_t align) override {
+    mm_detail::deallocate(p, bytes, align);
+  }
+
+  /* there is only one heap, so any mm_resource frees what another one got */
+  bool do_is_equal(const std::pmr::memory_resource &other)
+    const noexcept override {
+    return dynamic_cast<const mm_resource *>(&other) != nullptr;
+  }
+};
+
+/* The resource shared by all users, like std::pmr::new_delete_resource. */
+inline mm_resource *mm_get_resource() {
+  static mm_resource resource;
+  return &resource;
+}
+
+template <class T> struct mm_allocator {
+  using value_type = T;
+
+  mm_allocator() noexcept = default;
+  template <class U> mm_allocator(const mm_allocator<U> &) noexcept {}
+
+  T *allocate(std::size_t n) {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+      throw std::bad_array_new_length();
+    return static_cast<T *>(mm_detail::allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) noexcept {
+    mm_detail::deallocate(p, n * sizeof(T), alignof(T));
+  }
+};
+
+template <class T, class U>
+bool operator==(const mm_allocator<T> &, const mm_allocator<U> &) noexcept {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const mm_allocator<T> &, const mm_allocator<U> &) noexcept {
+  return false;
+}
+
+#ifndef DRIVER
+#undef mm_malloc
+#undef mm_free
+#undef mm_aligned_alloc
+#undef mm_free_sized
+#endif
+
+#endif /* !MM_RESOURCE_H */
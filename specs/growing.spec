@@ -0,0 +1,8 @@
+# Live set growing slowly from 100 KB to 4 MB, with mixed lifetimes
+ops=500000
+seed=3
+size=uniform:8:512
+life=pareto:50:0.8
+longlived=0.01
+realloc=0.02
+live=100000:4000000
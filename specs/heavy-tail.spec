@@ -0,0 +1,9 @@
+# Pareto sizes with a few huge requests, most blocks short-lived
+ops=200000
+seed=1
+size=pareto:16:1.2
+maxsize=262144
+life=exp:200
+longlived=0.02
+realloc=0.05
+live=2000000
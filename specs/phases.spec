@@ -0,0 +1,6 @@
+# Producer/consumer: batches of objects allocated, then all consumed
+ops=200000
+seed=2
+size=lognormal:4:1
+life=fixed:1000000
+phase=5000
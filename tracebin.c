@@ -0,0 +1,106 @@
+/*
+ * tracebin.c - encoder and decoder of the binary trace format.
+ *
+ * A text trace request takes about 10 bytes and a parsed one 16 bytes. Here a
+ * typical request takes 3 to 4 bytes and is decoded straight from a mapping
+ * of the file, so traces of any length replay in bounded memory.
+ */
+#include <limits.h>
+
+#include "tracebin.h"
+
+static int put_varint(FILE *f, uint64_t v) {
+  uint8_t buf[10];
+  int n = 0;
+
+  do {
+    buf[n] = v & 0x7f;
+    v >>= 7;
+    if (v)
+      buf[n] |= 0x80;
+    n++;
+  } while (v);
+
+  return fwrite(buf, 1, n, f) == (size_t)n ? 0 : -1;
+}
+
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end,
+                                        uint64_t *v) {
+  uint64_t x = 0;
+
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    uint8_t b = *p++;
+    x |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *v = x;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+int tracebin_write_header(FILE *f, const tracebin_hdr_t *hdr) {
+  return fwrite(hdr, sizeof(*hdr), 1, f) == 1 ? 0 : -1;
+}
+
+int tracebin_write_op(FILE *f, const tracebin_op_t *op, uint32_t flags) {
+  if (put_varint(f, ((uint64_t)(op->id + 1) << 3) | op->type))
+    return -1;
+  if (op->type == TR_RALLOC && put_varint(f, op->region))
+    return -1;
+  if ((op->type == TR_ALLOC || op->type == TR_RALLOC ||
+       op->type == TR_REALLOC) &&
+      put_varint(f, op->size))
+    return -1;
+  if ((flags & TRACEBIN_THREADS) && put_varint(f, op->thread))
+    return -1;
+  if ((flags & TRACEBIN_TIME) && put_varint(f, op->time))
+    return -1;
+  return 0;
+}
+
+const uint8_t *tracebin_read_op(const uint8_t *p, const uint8_t *end,
+                                uint32_t flags, tracebin_op_t *op) {
+  uint64_t tag, v;
+
+  /* ids, regions and threads must fit in an int, or they wrap negative */
+  if (!(p = get_varint(p, end, &tag)) || (tag >> 3) > INT_MAX)
+    return NULL;
+  op->type = tag & 7;
+  op->id = (int)(tag >> 3) - 1;
+  op->region = -1;
+  op->size = 0;
+  op->thread = 0;
+  op->time = 0;
+
+  switch (op->type) {
+    case TR_RALLOC:
+      if (!(p = get_varint(p, end, &v)) || v > INT_MAX)
+        return NULL;
+      op->region = v;
+      /* fall through */
+    case TR_ALLOC:
+    case TR_REALLOC:
+      if (!(p = get_varint(p, end, &v)))
+        return NULL;
+      op->size = v;
+      /* fall through */
+    case TR_FREE:
+      break;
+    case TR_RESET:
+      if (op->id < 0)
+        return NULL;
+      break;
+    default:
+      return NULL;
+  }
+
+  if (flags & TRACEBIN_THREADS) {
+    if (!(p = get_varint(p, end, &v)) || v > INT_MAX)
+      return NULL;
+    op->thread = v;
+  }
+  if ((flags & TRACEBIN_TIME) && !(p = get_varint(p, end, &op->time)))
+    return NULL;
+  return p;
+}
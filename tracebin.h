@@ -0,0 +1,48 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Binary trace format. A fixed header is followed by num_ops requests, each
+ * a varint tag ((id + 1) << 3 | type), then the region for TR_RALLOC and
+ * the size for TR_ALLOC, TR_RALLOC and TR_REALLOC. The id of TR_FREE may be
+ * -1 (free of NULL), the id of TR_RESET is the region. Depending on the
+ * header flags, the thread and the ns elapsed since the previous request
+ * follow. Varints store 7 bits per byte, least significant first, high bit
+ * set on all but the last byte.
+ */
+#define TRACEBIN_MAGIC 0x4254524d /* "MRTB" when stored little endian */
+#define TRACEBIN_VERSION 1
+
+/* header flags */
+#define TRACEBIN_THREADS 1 /* requests carry a thread number */
+#define TRACEBIN_TIME 2    /* requests carry a time delta */
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t weight;      /* as in .rep files */
+  uint32_t num_ids;     /* number of alloc/realloc ids */
+  uint32_t num_regions; /* number of region ids */
+  uint32_t flags;       /* TRACEBIN_THREADS, TRACEBIN_TIME */
+  uint64_t num_ops;     /* number of requests */
+} tracebin_hdr_t;
+
+/* same order as request types in mdriver */
+enum { TR_ALLOC, TR_FREE, TR_REALLOC, TR_RALLOC, TR_RESET };
+
+typedef struct {
+  int type;
+  int id;     /* block id, or region for TR_RESET */
+  int region;    /* only for TR_RALLOC */
+  size_t size;   /* for allocations */
+  int thread;    /* with TRACEBIN_THREADS */
+  uint64_t time; /* with TRACEBIN_TIME, ns since the previous request */
+} tracebin_op_t;
+
+/* Returns 0 on success, -1 on write error. */
+extern int tracebin_write_header(FILE *f, const tracebin_hdr_t *hdr);
+extern int tracebin_write_op(FILE *f, const tracebin_op_t *op, uint32_t flags);
+/* Decode one request at p. Returns the next request or NULL if malformed. */
+extern const uint8_t *tracebin_read_op(const uint8_t *p, const uint8_t *end,
+                                       uint32_t flags, tracebin_op_t *op);
@@ -0,0 +1,391 @@
+/*
+ * tracegen.c - generate synthetic traces from a workload spec.
+ *
+ * Usage: tracegen -o <output> [<spec file>] [key=value...]
+ *
+ * The spec is a list of key=value settings, read from the file and then from
+ * the command line, '#' starts a comment:
+ *
+ *   ops=N         number of requests, not counting the final frees (100000)
+ *   seed=N        seed of the random generator (1)
+ *   size=DIST     request sizes (exp:64)
+ *   maxsize=N     sizes above N are clamped to N (1048576)
+ *   life=DIST     lifetime of a block, in requests (exp:1000)
+ *   longlived=P   fraction of blocks that are never freed before the end (0)
+ *   realloc=P     probability that a request reallocs a live block to a new
+ *                 size from the size distribution (0)
+ *   live=A[:B]    target of live bytes, ramped from A to B over the trace;
+ *                 above it the blocks closest to dying are freed early,
+ *                 below it no block dies (none)
+ *   phase=N       alternate N requests of producing (no frees but the forced
+ *                 ones) and N requests of consuming (frees only) (none)
+ *   threads=N     give every block a random thread that allocates and
+ *                 reallocs it (1)
+ *   remote=P      probability that a block is freed by another thread (0)
+ *
+ * Distributions are fixed:N, uniform:LO:HI, exp:MEAN, lognormal:MU:SIGMA or
+ * pareto:MIN:ALPHA. The trace is written in the binary format, or as text if
+ * the output name ends with .rep and there is a single thread. The same spec
+ * always gives the same trace. Every free and realloc refers to a live block
+ * and all blocks are freed at the end, so traces are valid for any number of
+ * requests, while memory use only depends on the live set.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracebin.h"
+
+typedef struct {
+  enum { D_FIXED, D_UNIFORM, D_EXP, D_LOGNORMAL, D_PARETO } kind;
+  double a, b;
+} dist_t;
+
+typedef struct {
+  int id;         /* block id in the trace */
+  int heappos;    /* position in the heap of deaths */
+  int livepos;    /* position in the array of live blocks */
+  int thread;     /* thread that allocated it */
+  size_t size;    /* current size */
+  uint64_t death; /* request number at which the block dies */
+} block_t;
+
+/* the spec */
+static long ops = 100000;
+static uint64_t seed = 1;
+static dist_t size_dist = {D_EXP, 64, 0};
+static size_t maxsize = 1 << 20;
+static dist_t life_dist = {D_EXP, 1000, 0};
+static double longlived = 0;
+static double realloc_p = 0;
+static double live_from = 0, live_to = 0;
+static long phase = 0;
+static int threads = 1;
+static double remote = 0;
+
+/* the simulation */
+static block_t *blocks; /* slots for live blocks... */
+static int nslots;
+static int *freeslots; /* ... unused slots */
+static int nfree;
+static int *heap; /* live blocks ordered by death */
+static int *live; /* live blocks in no particular order */
+static int nlive;
+static double live_bytes;
+
+/* the output */
+static FILE *out;
+static const char *outname;
+static int text;
+static tracebin_hdr_t hdr = {.magic = TRACEBIN_MAGIC,
+                             .version = TRACEBIN_VERSION,
+                             .weight = 1};
+
+static void die(const char *msg, const char *arg) {
+  fprintf(stderr, "tracegen: %s%s\n", msg, arg);
+  exit(EXIT_FAILURE);
+}
+
+/*
+ * Random numbers: splitmix64, so that traces don't depend on the libc.
+ */
+static uint64_t next_random(void) {
+  uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* uniform in (0, 1) */
+static double uniform(void) {
+  return ((next_random() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double sample(const dist_t *d) {
+  switch (d->kind) {
+    case D_FIXED:
+      return d->a;
+    case D_UNIFORM:
+      return d->a + (d->b - d->a + 1) * uniform();
+    case D_EXP:
+      return -d->a * log(uniform());
+    case D_LOGNORMAL:
+      return exp(d->a + d->b * sqrt(-2 * log(uniform())) *
+                          cos(2 * M_PI * uniform()));
+    case D_PARETO:
+      return d->a / pow(uniform(), 1 / d->b);
+  }
+  return 0;
+}
+
+static void parse_dist(dist_t *d, const char *s) {
+  static const struct {
+    const char *name;
+    int kind, nargs;
+  } kinds[] = {{"fixed", D_FIXED, 1},
+               {"uniform", D_UNIFORM, 2},
+               {"exp", D_EXP, 1},
+               {"lognormal", D_LOGNORMAL, 2},
+               {"pareto", D_PARETO, 2}};
+  char name[32];
+  int n = 0;
+
+  if (sscanf(s, "%31[^:]:%lf%n", name, &d->a, &n) != 2)
+    die("bad distribution ", s);
+  for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+    if (strcmp(name, kinds[i].name))
+      continue;
+    d->kind = kinds[i].kind;
+    if (kinds[i].nargs == 2 && sscanf(s + n, ":%lf", &d->b) != 1)
+      die("missing parameter in ", s);
+    return;
+  }
+  die("unknown distribution ", s);
+}
+
+static void set(const char *kv) {
+  char key[32];
+  const char *val;
+
+  if (!(val = strchr(kv, '=')) || val - kv >= (long)sizeof(key))
+    die("expected key=value, got ", kv);
+  memcpy(key, kv, val - kv);
+  key[val++ - kv] = '\0';
+
+  if (!strcmp(key, "ops"))
+    ops = atol(val);
+  else if (!strcmp(key, "seed"))
+    seed = strtoull(val, NULL, 0);
+  else if (!strcmp(key, "size"))
+    parse_dist(&size_dist, val);
+  else if (!strcmp(key, "maxsize"))
+    maxsize = atol(val);
+  else if (!strcmp(key, "life"))
+    parse_dist(&life_dist, val);
+  else if (!strcmp(key, "longlived"))
+    longlived = atof(val);
+  else if (!strcmp(key, "realloc"))
+    realloc_p = atof(val);
+  else if (!strcmp(key, "live")) {
+    if (sscanf(val, "%lf:%lf", &live_from, &live_to) == 1)
+      live_to = live_from;
+  } else if (!strcmp(key, "phase"))
+    phase = atol(val);
+  else if (!strcmp(key, "threads"))
+    threads = atoi(val) > 1 ? atoi(val) : 1;
+  else if (!strcmp(key, "remote"))
+    remote = atof(val);
+  else
+    die("unknown key ", key);
+}
+
+static void read_spec(const char *name) {
+  FILE *f;
+  char line[256];
+
+  if (!(f = fopen(name, "r")))
+    die("could not open ", name);
+  while (fgets(line, sizeof(line), f)) {
+    char kv[256];
+    line[strcspn(line, "#")] = '\0';
+    if (sscanf(line, "%255s", kv) == 1)
+      set(kv);
+  }
+  fclose(f);
+}
+
+static void emit(int type, int id, size_t size, int thread) {
+  int err;
+
+  if (text) {
+    static const char code[] = {'a', 'f', 'r'};
+    if (type == TR_FREE)
+      err = fprintf(out, "f %d\n", id) < 0;
+    else
+      err = fprintf(out, "%c %d %zu\n", code[type], id, size) < 0;
+  } else {
+    tracebin_op_t op = {.type = type, .id = id, .region = -1, .size = size};
+    op.thread = thread;
+    err = tracebin_write_op(out, &op, hdr.flags);
+  }
+  if (err)
+    die("could not write ", outname);
+  hdr.num_ops++;
+}
+
+static void write_header(void) {
+  int err;
+
+  if (text) {
+    /* padded, so that it can be rewritten with the final counts */
+    err = fprintf(out, "%u\n%-11u\n%-11lu\n0\n", hdr.weight, hdr.num_ids,
+                  (unsigned long)hdr.num_ops) < 0;
+  } else {
+    err = tracebin_write_header(out, &hdr);
+  }
+  if (err)
+    die("could not write ", outname);
+}
+
+/*
+ * Heap of live blocks ordered by death
+ */
+static void heap_swap(int i, int j) {
+  int t = heap[i];
+  heap[i] = heap[j];
+  heap[j] = t;
+  blocks[heap[i]].heappos = i;
+  blocks[heap[j]].heappos = j;
+}
+
+static void heap_up(int i) {
+  while (i > 0 && blocks[heap[(i - 1) / 2]].death > blocks[heap[i]].death) {
+    heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void heap_down(int i) {
+  for (;;) {
+    int m = i, l = 2 * i + 1, r = 2 * i + 2;
+    if (l < nlive && blocks[heap[l]].death < blocks[heap[m]].death)
+      m = l;
+    if (r < nlive && blocks[heap[r]].death < blocks[heap[m]].death)
+      m = r;
+    if (m == i)
+      return;
+    heap_swap(i, m);
+    i = m;
+  }
+}
+
+static size_t draw_size(void) {
+  double s = sample(&size_dist);
+  if (s < 1)
+    return 1;
+  return s > maxsize ? maxsize : (size_t)s;
+}
+
+static void do_alloc(uint64_t now) {
+  if (nfree == 0) {
+    int n = nslots ? 2 * nslots : 1024;
+    if (!(blocks = realloc(blocks, n * sizeof(block_t))) ||
+        !(freeslots = realloc(freeslots, n * sizeof(int))) ||
+        !(heap = realloc(heap, n * sizeof(int))) ||
+        !(live = realloc(live, n * sizeof(int))))
+      die("out of memory", "");
+    for (int i = n - 1; i >= nslots; i--)
+      freeslots[nfree++] = i;
+    nslots = n;
+  }
+
+  if (hdr.num_ids == INT32_MAX)
+    die("too many blocks", "");
+
+  int s = freeslots[--nfree];
+  block_t *b = &blocks[s];
+  b->id = hdr.num_ids++;
+  b->size = draw_size();
+  b->thread = threads > 1 ? next_random() % threads : 0;
+  if (uniform() < longlived) {
+    b->death = UINT64_MAX;
+  } else {
+    /* heavy tails draw lives too long for uint64_t, even infinite ones; all
+       that outlive the trace are the same to it */
+    double life = sample(&life_dist);
+    b->death = now + 1 + (life < ops ? (uint64_t)life : (uint64_t)ops);
+  }
+
+  b->heappos = b->livepos = nlive;
+  heap[nlive] = live[nlive] = s;
+  nlive++;
+  heap_up(b->heappos);
+  live_bytes += b->size;
+
+  emit(TR_ALLOC, b->id, b->size, b->thread);
+}
+
+static void do_free_first(void) {
+  int s = heap[0];
+  block_t *b = &blocks[s];
+
+  int thread = b->thread;
+  if (threads > 1 && uniform() < remote)
+    thread = (thread + 1 + next_random() % (threads - 1)) % threads;
+
+  emit(TR_FREE, b->id, 0, thread);
+  live_bytes -= b->size;
+  nlive--;
+
+  heap_swap(0, nlive);
+  heap_down(0);
+
+  live[b->livepos] = live[nlive];
+  blocks[live[nlive]].livepos = b->livepos;
+
+  freeslots[nfree++] = s;
+}
+
+static void do_realloc(void) {
+  block_t *b = &blocks[live[next_random() % nlive]];
+
+  live_bytes -= b->size;
+  b->size = draw_size();
+  live_bytes += b->size;
+  emit(TR_REALLOC, b->id, b->size, b->thread);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3 || strcmp(argv[1], "-o")) {
+    fprintf(stderr,
+            "Usage: tracegen -o <output> [<spec file>] [key=value...]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  outname = argv[2];
+  for (int i = 3; i < argc; i++) {
+    if (strchr(argv[i], '='))
+      set(argv[i]);
+    else
+      read_spec(argv[i]);
+  }
+
+  size_t len = strlen(outname);
+  text = len >= 4 && !strcmp(outname + len - 4, ".rep");
+  if (text && threads > 1)
+    die("text traces have no threads: ", outname);
+  if (threads > 1)
+    hdr.flags |= TRACEBIN_THREADS;
+  if (!(out = fopen(outname, "w")))
+    die("could not create ", outname);
+  write_header();
+
+  for (uint64_t now = 0; now < (uint64_t)ops; now++) {
+    double target = live_from + (live_to - live_from) * now / ops;
+    int producing = phase && (now / phase) % 2 == 0;
+    int consuming = phase && (now / phase) % 2 == 1;
+
+    int below = target > 0 && live_bytes < target;
+    int above = target > 0 && live_bytes > target;
+
+    if (nlive > 0 && ((!producing && !below && blocks[heap[0]].death <= now) ||
+                      above || consuming))
+      do_free_first();
+    else if (nlive > 0 && uniform() < realloc_p)
+      do_realloc();
+    else
+      do_alloc(now);
+  }
+
+  while (nlive > 0)
+    do_free_first();
+
+  /* rewrite the header with the final counts */
+  if (fseek(out, 0, SEEK_SET))
+    die("could not write ", outname);
+  write_header();
+  if (fclose(out))
+    die("could not write ", outname);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,484 @@
+/*
+ * traceinfo.c - describe the workload of traces.
+ *
+ * Usage: traceinfo [-p <points>] <trace>...
+ *
+ * Reads text (.rep) and binary traces and prints, for each of them:
+ *
+ *   - histograms of the sizes of malloc and realloc requests,
+ *   - the lifetime of blocks, in requests from allocation to free,
+ *   - the live set (blocks and bytes) at <points> requests (default 20),
+ *   - how reallocs change the size of blocks,
+ *   - the share of requests in each size class of mm.c.
+ *
+ * With more than one trace, the histograms of all of them are printed last.
+ * Histogram buckets are powers of two. Binary traces are decoded straight
+ * from a mapping of the file, so even the longest traces take seconds.
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "memlib.h"
+#include "tracebin.h"
+
+/* block sizes and classes as computed by mm.c: 4-byte header, first class 16
+   bytes, lists up to LISTNUM_MAX / 2 and one list for all larger blocks. The
+   Makefile includes mm-config.h, as for mm.c, if tune.py wrote one. */
+#ifndef LISTNUM_MAX
+#define LISTNUM_MAX 8192
+#endif
+#define MM_WORD 4
+#define MM_MIN_CLASS 16
+#define MM_MAX_CLASS (LISTNUM_MAX / 2)
+#define MM_CLASSES (__builtin_ctz(LISTNUM_MAX) - 3)
+
+#define BUCKETS 65
+
+typedef struct {
+  uint64_t count[BUCKETS]; /* bucket b holds values of b bits */
+  uint64_t n;
+  double sum;
+  uint64_t max;
+} hist_t;
+
+/* how a realloc changes the size of its block: new / old */
+static const char *ratio_names[] = {
+  "shrink below 1/2", "shrink", "same size", "grow up to 1.25x",
+  "grow up to 1.5x",  "grow up to 2x", "grow more than 2x",
+};
+#define RATIOS (sizeof(ratio_names) / sizeof(ratio_names[0]))
+
+typedef struct {
+  uint64_t ops[TR_RESET + 1]; /* requests of each type */
+  hist_t alloc_sizes;         /* malloc and region allocations */
+  hist_t realloc_sizes;
+  hist_t lifetimes;        /* requests from allocation to free */
+  uint64_t never_freed;    /* blocks live at the end */
+  uint64_t ratios[RATIOS]; /* how reallocs change sizes */
+  hist_t reallocs;         /* reallocs per block that was reallocated */
+  uint64_t classes[MM_CLASSES];
+} info_t;
+
+/* state of one block */
+typedef struct {
+  uint64_t birth; /* request that allocated it */
+  size_t size;
+  int reallocs;
+  int next; /* next block of the same region */
+  char live;
+} block_t;
+
+/* reads requests of a text or binary trace */
+typedef struct {
+  const char *name;
+  FILE *text;             /* text trace, or... */
+  const uint8_t *p, *end; /* ... the mapping of a binary one */
+  void *map;
+  size_t maplen;
+  uint32_t flags;
+  uint64_t num_ops;
+  int num_ids;
+  int num_regions; /* INT_MAX for text traces, which don't say */
+} reader_t;
+
+static int points = 20;
+
+static void die(const char *msg, const char *name) {
+  fprintf(stderr, "traceinfo: %s %s\n", msg, name);
+  exit(EXIT_FAILURE);
+}
+
+static void *xcalloc(size_t n, size_t size) {
+  void *p = calloc(n ? n : 1, size);
+  if (!p)
+    die("out of memory", "");
+  return p;
+}
+
+static void hist_add(hist_t *h, uint64_t v) {
+  h->count[v ? 64 - __builtin_clzll(v) : 0]++;
+  h->n++;
+  h->sum += v;
+  if (v > h->max)
+    h->max = v;
+}
+
+static void hist_merge(hist_t *to, const hist_t *h) {
+  for (int b = 0; b < BUCKETS; b++)
+    to->count[b] += h->count[b];
+  to->n += h->n;
+  to->sum += h->sum;
+  if (h->max > to->max)
+    to->max = h->max;
+}
+
+static void info_merge(info_t *to, const info_t *in) {
+  for (int t = 0; t <= TR_RESET; t++)
+    to->ops[t] += in->ops[t];
+  hist_merge(&to->alloc_sizes, &in->alloc_sizes);
+  hist_merge(&to->realloc_sizes, &in->realloc_sizes);
+  hist_merge(&to->lifetimes, &in->lifetimes);
+  to->never_freed += in->never_freed;
+  for (size_t r = 0; r < RATIOS; r++)
+    to->ratios[r] += in->ratios[r];
+  hist_merge(&to->reallocs, &in->reallocs);
+  for (int c = 0; c < MM_CLASSES; c++)
+    to->classes[c] += in->classes[c];
+}
+
+/* index of the class mm.c puts a request of this size in */
+static int mm_class(size_t size) {
+  size_t blksz = (size + MM_WORD + ALIGNMENT - 1) & -ALIGNMENT;
+  int c = 0;
+
+  for (size_t limit = MM_MIN_CLASS; limit < blksz && c < MM_CLASSES - 1;
+       limit *= 2)
+    c++;
+  return c;
+}
+
+static int ratio_bucket(size_t old, size_t size) {
+  if (size == old)
+    return 2;
+  if (size < old)
+    return 2 * size < old ? 0 : 1;
+  if (4 * size <= 5 * old)
+    return 3;
+  if (2 * size <= 3 * old)
+    return 4;
+  return size <= 2 * old ? 5 : 6;
+}
+
+static void open_trace(reader_t *r, const char *name) {
+  tracebin_hdr_t hdr;
+  struct stat st;
+  int fd, weight, num_ops, ignore;
+
+  memset(r, 0, sizeof(*r));
+  r->name = name;
+  if ((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+    die("could not open", name);
+
+  if (read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+      hdr.magic == TRACEBIN_MAGIC) {
+    if (hdr.version != TRACEBIN_VERSION)
+      die("unknown binary trace version in", name);
+    if (hdr.num_ids > INT_MAX || hdr.num_regions > INT_MAX)
+      die("bad header in", name);
+    r->maplen = st.st_size;
+    r->map = mmap(NULL, r->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (r->map == MAP_FAILED)
+      die("could not map", name);
+    madvise(r->map, r->maplen, MADV_SEQUENTIAL);
+    r->p = (const uint8_t *)r->map + sizeof(hdr);
+    r->end = (const uint8_t *)r->map + r->maplen;
+    r->flags = hdr.flags;
+    r->num_ops = hdr.num_ops;
+    r->num_ids = hdr.num_ids;
+    r->num_regions = hdr.num_regions;
+    close(fd);
+    return;
+  }
+
+  if (lseek(fd, 0, SEEK_SET) < 0 || !(r->text = fdopen(fd, "r")))
+    die("could not read", name);
+  if (fscanf(r->text, "%d %d %d %d", &weight, &r->num_ids, &num_ops,
+             &ignore) != 4 ||
+      r->num_ids < 0 || num_ops < 0)
+    die("bad header in", name);
+  r->num_ops = num_ops;
+  r->num_regions = INT_MAX;
+}
+
+static void close_trace(reader_t *r) {
+  if (r->text)
+    fclose(r->text);
+  else
+    munmap(r->map, r->maplen);
+}
+
+/* Read the next request, in the binary format's terms. */
+static void next_op(reader_t *r, tracebin_op_t *op) {
+  unsigned long size = 0;
+  char type;
+  int n;
+
+  if (!r->text) {
+    if (!(r->p = tracebin_read_op(r->p, r->end, r->flags, op)))
+      die("malformed request in", r->name);
+    return;
+  }
+
+  memset(op, 0, sizeof(*op));
+  op->region = -1;
+  if (fscanf(r->text, " %c", &type) != 1)
+    die("too few requests in", r->name);
+  switch (type) {
+    case 'a':
+      op->type = TR_ALLOC;
+      n = fscanf(r->text, "%d %lu", &op->id, &size) - 2;
+      break;
+    case 'r':
+      op->type = TR_REALLOC;
+      n = fscanf(r->text, "%d %lu", &op->id, &size) - 2;
+      break;
+    case 'f':
+      op->type = TR_FREE;
+      n = fscanf(r->text, "%d", &op->id) - 1;
+      break;
+    case 'A':
+      op->type = TR_RALLOC;
+      n = fscanf(r->text, "%d %d %lu", &op->region, &op->id, &size) - 3;
+      break;
+    case 'x':
+      op->type = TR_RESET;
+      n = fscanf(r->text, "%d", &op->id) - 1;
+      break;
+    default:
+      die("bogus request type in", r->name);
+  }
+  if (n)
+    die("malformed request in", r->name);
+  op->size = size;
+}
+
+static void kill_block(info_t *in, block_t *b, uint64_t i, uint64_t *live,
+                       uint64_t *live_bytes) {
+  if (!b->live)
+    return;
+  b->live = 0;
+  hist_add(&in->lifetimes, i - b->birth);
+  if (b->reallocs)
+    hist_add(&in->reallocs, b->reallocs);
+  (*live)--;
+  *live_bytes -= b->size;
+}
+
+static void print_hist(const char *title, const hist_t *h) {
+  double cum = 0;
+
+  if (h->n == 0)
+    return;
+  printf("\n%-24s %12s %6s %6s\n", title, "count", "%", "cum%");
+  for (int b = 0; b < BUCKETS; b++) {
+    char range[48];
+
+    if (h->count[b] == 0)
+      continue;
+    cum += h->count[b];
+    if (b <= 1)
+      snprintf(range, sizeof(range), "%d", b);
+    else
+      snprintf(range, sizeof(range), "%llu..%llu", 1ULL << (b - 1),
+               (2ULL << (b - 1)) - 1);
+    printf("  %-22s %12llu %6.1f %6.1f\n", range,
+           (unsigned long long)h->count[b], 100.0 * h->count[b] / h->n,
+           100 * cum / h->n);
+  }
+  printf("  mean %.1f, max %llu\n", h->sum / h->n, (unsigned long long)h->max);
+}
+
+static void print_info(const info_t *in) {
+  uint64_t reallocs = in->ops[TR_REALLOC], requests = 0;
+
+  printf("\n%llu malloc, %llu realloc, %llu free, %llu reset\n",
+         (unsigned long long)(in->ops[TR_ALLOC] + in->ops[TR_RALLOC]),
+         (unsigned long long)in->ops[TR_REALLOC],
+         (unsigned long long)in->ops[TR_FREE],
+         (unsigned long long)in->ops[TR_RESET]);
+  print_hist("malloc sizes", &in->alloc_sizes);
+  print_hist("realloc sizes", &in->realloc_sizes);
+  print_hist("lifetimes (requests)", &in->lifetimes);
+  if (in->never_freed)
+    printf("  %llu blocks never freed\n", (unsigned long long)in->never_freed);
+
+  if (reallocs) {
+    printf("\n%-24s %12s %6s\n", "realloc growth", "count", "%");
+    for (size_t r = 0; r < RATIOS; r++)
+      printf("  %-22s %12llu %6.1f\n", ratio_names[r],
+             (unsigned long long)in->ratios[r],
+             100.0 * in->ratios[r] / reallocs);
+    print_hist("reallocs per block", &in->reallocs);
+  }
+
+  for (int c = 0; c < MM_CLASSES; c++)
+    requests += in->classes[c];
+  if (requests == 0)
+    return;
+  printf("\n%-24s %12s %6s %6s\n", "mm.c size classes", "count", "%", "cum%");
+  double cum = 0;
+  for (int c = 0; c < MM_CLASSES; c++) {
+    char name[32];
+    cum += in->classes[c];
+    if (c < MM_CLASSES - 1)
+      snprintf(name, sizeof(name), "list%d", MM_MIN_CLASS << c);
+    else if (c > 0)
+      snprintf(name, sizeof(name), "larger than %d", MM_MAX_CLASS);
+    else
+      snprintf(name, sizeof(name), "all sizes");
+    printf("  %-22s %12llu %6.1f %6.1f\n", name,
+           (unsigned long long)in->classes[c],
+           100.0 * in->classes[c] / requests, 100 * cum / requests);
+  }
+}
+
+/*
+ * analyze - Replay one trace, printing its live set as it goes and its
+ *     histograms at the end, and add them to total
+ */
+static void analyze(const char *name, info_t *total) {
+  uint64_t live = 0, live_bytes = 0, peak = 0, peak_bytes = 0;
+  uint64_t peak_at = 0, peak_bytes_at = 0, every;
+  int *region_head = NULL, num_regions = 0;
+  tracebin_op_t op;
+  info_t info;
+  reader_t r;
+
+  memset(&info, 0, sizeof(info));
+  open_trace(&r, name);
+  block_t *blocks = xcalloc(r.num_ids, sizeof(block_t));
+  every = r.num_ops / points ? r.num_ops / points : 1;
+
+  printf("%s: %llu requests, %d blocks\n", name,
+         (unsigned long long)r.num_ops, r.num_ids);
+  printf("\n%-24s %12s %12s\n", "live set at request", "blocks", "bytes");
+
+  for (uint64_t i = 0; i < r.num_ops; i++) {
+    block_t *b = NULL;
+
+    next_op(&r, &op);
+    if (op.type == TR_RESET
+          ? op.id < 0 || op.id >= r.num_regions
+          : op.id < -1 || op.id >= r.num_ids ||
+              (op.id < 0 && op.type != TR_FREE) ||
+              (op.type == TR_RALLOC &&
+               (op.region < 0 || op.region >= r.num_regions)))
+      die("request out of range in", name);
+    if (op.type != TR_RESET && op.id >= 0)
+      b = &blocks[op.id];
+    info.ops[op.type]++;
+
+    switch (op.type) {
+      case TR_RALLOC:
+        if (op.region >= num_regions) {
+          int n = op.region + 1;
+          if (!(region_head = realloc(region_head, n * sizeof(int))))
+            die("out of memory", "");
+          while (num_regions < n)
+            region_head[num_regions++] = -1;
+        }
+        b->next = region_head[op.region];
+        region_head[op.region] = op.id;
+        /* fall through */
+      case TR_ALLOC:
+        hist_add(&info.alloc_sizes, op.size);
+        info.classes[mm_class(op.size)]++;
+        b->birth = i;
+        b->size = op.size;
+        b->reallocs = 0;
+        b->live = 1;
+        live++;
+        live_bytes += op.size;
+        break;
+
+      case TR_REALLOC:
+        hist_add(&info.realloc_sizes, op.size);
+        info.classes[mm_class(op.size)]++;
+        if (!b->live) {
+          /* realloc of NULL */
+          b->birth = i;
+          b->size = 0;
+          b->reallocs = 0;
+          b->live = 1;
+          live++;
+        }
+        info.ratios[ratio_bucket(b->size, op.size)]++;
+        live_bytes += op.size - b->size;
+        b->size = op.size;
+        b->reallocs++;
+        break;
+
+      case TR_FREE:
+        if (b)
+          kill_block(&info, b, i, &live, &live_bytes);
+        break;
+
+      case TR_RESET:
+        if (op.id >= num_regions)
+          break;
+        for (int id = region_head[op.id]; id >= 0; id = blocks[id].next)
+          kill_block(&info, &blocks[id], i, &live, &live_bytes);
+        region_head[op.id] = -1;
+        break;
+    }
+
+    if (live > peak) {
+      peak = live;
+      peak_at = i;
+    }
+    if (live_bytes > peak_bytes) {
+      peak_bytes = live_bytes;
+      peak_bytes_at = i;
+    }
+    if (i % every == 0 || i == r.num_ops - 1)
+      printf("  %-22llu %12llu %12llu\n", (unsigned long long)i,
+             (unsigned long long)live, (unsigned long long)live_bytes);
+  }
+  printf("  peak %llu blocks at request %llu, %llu bytes at request %llu\n",
+         (unsigned long long)peak, (unsigned long long)peak_at,
+         (unsigned long long)peak_bytes, (unsigned long long)peak_bytes_at);
+
+  for (int id = 0; id < r.num_ids; id++) {
+    if (!blocks[id].live)
+      continue;
+    info.never_freed++;
+    if (blocks[id].reallocs)
+      hist_add(&info.reallocs, blocks[id].reallocs);
+  }
+
+  print_info(&info);
+  info_merge(total, &info);
+
+  free(blocks);
+  free(region_head);
+  close_trace(&r);
+}
+
+int main(int argc, char **argv) {
+  info_t total;
+  int c;
+
+  while ((c = getopt(argc, argv, "p:")) != -1) {
+    switch (c) {
+      case 'p':
+        if ((points = atoi(optarg)) < 1)
+          die("number of points must be positive:", optarg);
+        break;
+      default:
+        optind = argc + 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: traceinfo [-p <points>] <trace>...\n");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&total, 0, sizeof(total));
+  for (int i = optind; i < argc; i++) {
+    if (i > optind)
+      printf("\n\n");
+    analyze(argv[i], &total);
+  }
+
+  if (argc - optind > 1) {
+    printf("\n\nAll %d traces:\n", argc - optind);
+    print_info(&total);
+  }
+  return EXIT_SUCCESS;
+}
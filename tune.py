@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+"""Search the parameters of mm.c for the best utilization and speed.
+
+    ./tune.py [-j <jobs>] [-o mm-config.h] [--metric insn|time]
+              [--max-cost <c>] [NAME=v1,v2,...]...
+
+Every point of the parameter space is compiled into its own mdriver and
+scored like grade.py does: weighted memory utilization over the trace set,
+and instructions per operation from callgrind (--metric insn, the default
+when valgrind is installed) or nanoseconds per operation (--metric time).
+Points are evaluated in parallel. The table lists all points, the ones on
+the Pareto front are marked. The point with the best utilization on the
+front that costs at most --max-cost, by default 10% more than the current
+defaults of mm.c, is written to mm-config.h. The Makefile includes it when
+it compiles mm.c.
+"""
+
+import argparse
+import concurrent.futures
+import itertools
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import grade
+
+
+# parameters of mm.c that can be set from outside, and the values tried;
+# mm.c refuses to compile with values outside the ranges it documents
+SPACE = {
+    'SBRK_MIN': [128, 256, 512, 1024, 2048, 4096],
+    'LISTNUM_MAX': [1024, 2048, 4096, 8192],
+    'SLACK_DIV': [1, 2, 4, 8],
+}
+
+# cost allowed over that of the defaults, unless --max-cost is given
+MAX_SLOWDOWN = 1.1
+
+DRIVER_OBJS = ['mdriver.o', 'allocator.o', 'memlib.o', 'perfctr.o',
+               'region.o', 'tracebin.o']
+
+
+def make_vars():
+    """Return CC, CFLAGS and LDLIBS from the Makefile."""
+    found = {}
+    with open('Makefile') as f:
+        for line in f:
+            m = re.match(r'(CC|CFLAGS|LDLIBS)\s*=\s*(.*)', line)
+            if m and m.group(1) not in found:
+                found[m.group(1)] = m.group(2).split()
+    return found['CC'], found['CFLAGS'], found['LDLIBS']
+
+
+def build(point, workdir):
+    """Compile mm.c with the parameters of point, link it into an mdriver
+    in workdir and return its path."""
+    cc, cflags, ldlibs = make_vars()
+    defines = ['-D%s=%s' % kv for kv in point.items()]
+    obj = os.path.join(workdir, 'mm.o')
+    driver = os.path.join(workdir, 'mdriver')
+    subprocess.run(cc + cflags + defines + ['-c', '-o', obj, 'mm.c'],
+                   check=True)
+    subprocess.run(cc + cflags + ['-o', driver] + DRIVER_OBJS + [obj] +
+                   ldlibs, check=True)
+    return driver
+
+
+def callgrind_insn(driver, trace, workdir):
+    """Instructions spent in the allocator on trace, as grade.py counts
+    them."""
+    out = os.path.join(workdir, 'callgrind.out')
+    subprocess.run(['valgrind', '--tool=callgrind',
+                    '--callgrind-out-file=' + out,
+                    '--toggle-collect=mm_malloc', '--toggle-collect=mm_free',
+                    '--toggle-collect=mm_realloc',
+                    '--toggle-collect=mm_calloc',
+                    '--', driver, '-f', trace],
+                   capture_output=True, timeout=grade.TIMEOUT, check=True)
+    annotate = subprocess.run(['callgrind_annotate', out],
+                              capture_output=True, check=True)
+    for line in annotate.stdout.decode().splitlines():
+        if 'PROGRAM TOTALS' in line:
+            return int(line.strip().split()[0].replace(',', ''))
+    return 0
+
+
+def evaluate(point, traces, metric):
+    """Return the weighted utilization (%) and the cost per operation of
+    point, or None if mm.c fails on a trace."""
+    workdir = tempfile.mkdtemp(prefix='tune-')
+    try:
+        try:
+            driver = build(point, workdir)
+        except subprocess.CalledProcessError:
+            return None
+        runs = ['-k', '3'] if metric == 'time' else []
+        run = subprocess.run([driver, '-O', 'json', '-j', '1'] + runs + traces,
+                             capture_output=True)
+        results = [json.loads(line)
+                   for line in run.stdout.decode().splitlines()
+                   if line.startswith('{')]
+        if run.returncode or len(results) != len(traces) or \
+                not all(r['valid'] for r in results):
+            return None
+
+        all_ops = sum(r['ops'] for r in results)
+        util = sum(100 * r['util'] * r['ops'] for r in results) / all_ops
+        if metric == 'insn':
+            cost = sum(callgrind_insn(driver, t, workdir) for t in traces)
+        else:
+            cost = 1e9 * sum(r['secs'] for r in results)
+        return util, cost / all_ops
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+
+def pareto(scores):
+    """Indices of the scores not dominated by another one: no other point
+    has at least the utilization at no more cost, and is better in one."""
+    front = []
+    for i, (u, c) in enumerate(scores):
+        if not any(u2 >= u and c2 <= c and (u2 > u or c2 < c)
+                   for u2, c2 in scores):
+            front.append(i)
+    return front
+
+
+def write_config(path, point, score, metric):
+    with open(path, 'w') as f:
+        f.write('/* Parameters of mm.c picked by tune.py: weighted utilization '
+                '%.1f%%,\n   %.1f %s per operation. Delete this file to use '
+                'the defaults. */\n' %
+                (score[0], score[1],
+                 'instructions' if metric == 'insn' else 'ns'))
+        for name, value in point.items():
+            f.write('#define %s %s\n' % (name, value))
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='Search the parameters of mm.c.')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                        help='points evaluated at once')
+    parser.add_argument('-o', '--output', default='mm-config.h',
+                        help='config header to write')
+    parser.add_argument('--metric', choices=['insn', 'time'],
+                        default='insn' if shutil.which('valgrind') else 'time',
+                        help='cost per operation')
+    parser.add_argument('--max-cost', type=float,
+                        help='highest cost per operation to pick (default: '
+                        '10%% above the defaults)')
+    parser.add_argument('settings', nargs='*', metavar='NAME=v1,v2,...',
+                        help='values to try instead of the default ones')
+    args = parser.parse_args()
+
+    space = dict(SPACE)
+    for setting in args.settings:
+        name, _, values = setting.partition('=')
+        if name not in SPACE or not values:
+            parser.error('unknown parameter setting: %s' % setting)
+        space[name] = [int(v) for v in values.split(',')]
+    return args, space
+
+
+def main():
+    args, space = parse_args()
+    subprocess.run(['make', '-s'] + DRIVER_OBJS, check=True)
+
+    names = list(space)
+    points = [dict(zip(names, values))
+              for values in itertools.product(*space.values())]
+    traces = grade.TRACEFILES
+    print('Evaluating %d points on %d traces, cost in %s per operation' %
+          (len(points), len(traces),
+           'instructions' if args.metric == 'insn' else 'ns'))
+
+    # the last point has no settings: it is mm.c as it is
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        results = list(pool.map(
+            lambda p: evaluate(p, traces, args.metric), points + [{}]))
+    defaults = results.pop()
+    if defaults is None:
+        raise SystemExit('mm.c fails with its default parameters.')
+
+    failed = [p for p, r in zip(points, results) if r is None]
+    scored = [(p, r) for p, r in zip(points, results) if r is not None]
+    if not scored:
+        raise SystemExit('No point ran all traces correctly.')
+    front = set(pareto([r for _, r in scored]))
+
+    print('\n  %s %8s %10s' % (' '.join('%11s' % n for n in names), 'util',
+                               'cost'))
+    order = sorted(range(len(scored)), key=lambda i: -scored[i][1][0])
+    for i in order:
+        point, (util, cost) = scored[i]
+        print('%s %s %7.2f%% %10.1f' %
+              ('*' if i in front else ' ',
+               ' '.join('%11d' % point[n] for n in names), util, cost))
+    for point in failed:
+        print('  %s failed' % ' '.join('%11d' % point[n] for n in names))
+    print('  %s %7.2f%% %10.1f' % ('%35s' % 'defaults', *defaults))
+
+    max_cost = args.max_cost or MAX_SLOWDOWN * defaults[1]
+    candidates = [i for i in front if scored[i][1][1] <= max_cost]
+    if not candidates:
+        raise SystemExit('No point on the Pareto front is within --max-cost.')
+    best = max(candidates, key=lambda i: (scored[i][1][0], -scored[i][1][1]))
+    point, score = scored[best]
+    write_config(args.output, point, score, args.metric)
+    print('\nPicked %s, written to %s' %
+          (', '.join('%s=%d' % kv for kv in point.items()), args.output))
+
+
+if __name__ == '__main__':
+    sys.exit(main())